@@ -0,0 +1,54 @@
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ * Bump allocator for everything one assembly run creates and keeps until the object file is
+ * written: flink rows and actions, relocations. An allocation moves a pointer, nothing
+ * is freed on its own, the whole arena is released in one shot (release or destructor).
+ *
+ * Only trivially destructible types go in, destructors are never run.
+ */
+class Arena{
+private:
+    std::vector<char*> blocks;
+    char* cursor;
+    char* end;
+    size_t allocated;
+
+    void* allocate_block(size_t size, size_t alignment);
+
+public:
+    Arena(): cursor(nullptr), end(nullptr), allocated(0) {}
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment){
+        size_t padding = -reinterpret_cast<uintptr_t>(cursor) & (alignment - 1);
+
+        if(cursor == nullptr || (size_t)(end - cursor) < padding + size){
+            return allocate_block(size, alignment);
+        }
+
+        void* result = cursor + padding;
+        cursor += padding + size;
+        allocated += size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args){
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void release();
+
+    size_t get_allocated(){ return allocated; }
+};
@@ -9,9 +9,19 @@
 #include <fstream>
 
 #include "elfBase.h"
+#include "Helper.h"
+#include "Arena.h"
 using namespace std;
 
 #define WORD_SIZE 4
+#define DISPLACEMENT_MIN -2048 // D is a signed 12 bit field
+#define DISPLACEMENT_MAX 2047
+
+/**
+ * Thrown by every assembler error once its message is printed. It ends the assembly of
+ * this file only, the other files of a -j run go on (see Helper.cpp).
+ */
+class AssemblerError{};
 
 class Assembler {
 private:
@@ -21,6 +31,12 @@ private:
 
     // output file;
     string outputFileName;
+
+    // errors and progress of this file (cout, or the file's log in a -j run)
+    ostream* messages;
+
+    // flink and relocations of this file, released together with the assembler
+    Arena arena;
    
     /**
      * Symbol table
@@ -40,6 +56,7 @@ private:
     // undefined symbol index -> NDX; 
     static const int UND = -1;
     static const int EXT = -2;
+    static const int ABS = -3; // .equ constant
   
     struct SymbolTableRowStruct
     {
@@ -58,8 +75,36 @@ private:
 
     typedef SymbolTableRowStruct SymbolTableRow;
 
-    vector<SymbolTableRow*> symbolTable;
-    unordered_map<string, SymbolTableRow*> symbolTableMap;
+    /**
+     * Every name is interned once (intern_symbol), its id is the index of its row here and
+     * the row's num. Everything past the parser refers to symbols by id.
+     */
+    vector<SymbolTableRow> symbolTable;
+    unordered_map<string, int> symbolIds;
+
+    /**
+     * .equ
+     */
+    struct EquDefinitionStruct{
+        int symbol;
+        vector<string> expression; // postfix
+        int base; // external symbol the value is relative to, -1 if none
+
+        EquDefinitionStruct(int symbol, vector<string> expression): symbol(symbol), expression(expression), base(-1) {}
+    };
+    typedef EquDefinitionStruct EquDefinition;
+
+    // constant plus how many times each section (labels) or external symbol is added
+    struct ExpressionValueStruct{
+        int constant;
+        unordered_map<int, int> terms; // symbol id of the section or external symbol -> count
+
+        ExpressionValueStruct(): constant(0) {}
+    };
+    typedef ExpressionValueStruct ExpressionValue;
+
+    unordered_map<int, EquDefinition*> equTable;
+    unordered_map<int, vector<int>> equDependents; // symbol -> .equ symbols waiting for it
 
     /**
      * flink
@@ -71,43 +116,72 @@ private:
         uint32_t address;
         Operation operation;
         bool st8Relocation;
+        FLinkActionStruct* next; // actions of a row are a list in the arena, in order of address
   
 
         FLinkActionStruct(uint32_t addressParam, Operation operationParam, bool st8Relocation): 
-            address(addressParam), operation(operationParam), st8Relocation(st8Relocation) {}
+            address(addressParam), operation(operationParam), st8Relocation(st8Relocation), next(nullptr) {}
     };
     typedef FLinkActionStruct FLinkAction; 
     struct FLinkRowStruct{
-        string symbolIdentifier;
+        int symbol;
         int symbolValue;
-        vector<FLinkAction> fLinkAction;
+        FLinkAction* firstAction;
+        FLinkAction* lastAction;
 
-        FLinkRowStruct(string symbolIdentifierParam, int symbolValueParam, int addressParam, Operation operationParam, bool st8Relocation):
-            symbolIdentifier(symbolIdentifierParam), symbolValue(symbolValueParam)
-        {
-            fLinkAction.push_back(FLinkActionStruct(addressParam, operationParam, st8Relocation));
-        }
+        FLinkRowStruct(int symbolParam, int symbolValueParam):
+            symbol(symbolParam), symbolValue(symbolValueParam), firstAction(nullptr), lastAction(nullptr) {}
     };
     typedef FLinkRowStruct FLinkRow;
 
+    /**
+     * Literal pool: 32 bit constants and symbol addresses used by instructions of a section.
+     * The instructions read them with a pc relative memory operand, the pool is placed at
+     * .ltorg, at the end of the section, or (jumped over) when a reference would get out of range.
+     */
+    struct LiteralPoolEntryStruct{
+        int symbol; // -1 for constants
+        int value;
+
+        LiteralPoolEntryStruct(int symbol, int value): symbol(symbol), value(value) {}
+    };
+    typedef LiteralPoolEntryStruct LiteralPoolEntry;
+
+    struct LiteralPoolReferenceStruct{
+        uint32_t address; // instruction, its D field gets the distance to the entry
+        int entry;
+
+        LiteralPoolReferenceStruct(uint32_t address, int entry): address(address), entry(entry) {}
+    };
+    typedef LiteralPoolReferenceStruct LiteralPoolReference;
+
+    // pc relative branch waiting for a label further down in its section
+    struct BranchStruct{
+        uint32_t address;
+        int longInsCode; // the same branch through the literal pool, if the label isn't within reach
+        int symbol;
+
+        BranchStruct(uint32_t address, int longInsCode, int symbol): address(address), longInsCode(longInsCode), symbol(symbol) {}
+    };
+    typedef BranchStruct Branch;
+
     /**
      * Sections
      */
     struct SectionDefinitionStruct
     {
         string name;
+        int symbol; // the section's row in the symbol table
         uint32_t base;
         uint32_t length;
-        vector<FLinkRow*> fLinkTable;
-        unordered_map<string, FLinkRow*> fLinkTableMap;
+        vector<FLinkRow*> fLinkTable; // rows are in the arena
+        unordered_map<int, FLinkRow*> fLinkTableMap; // symbol -> its row in fLinkTable
         vector<uint8_t> data; // machine code
-
-        ~SectionDefinitionStruct(){
-            // delete flink table
-            for(FLinkRow* f: fLinkTable){
-                delete f;
-            }
-        }
+        vector<LiteralPoolEntry> literalPool; // not placed yet
+        unordered_map<int, int> literalPoolSymbols; // symbol -> entry
+        unordered_map<int, int> literalPoolConstants; // value -> entry
+        vector<LiteralPoolReference> literalPoolReferences; // sorted by address
+        vector<Branch> branches; // sorted by address
     };
     typedef SectionDefinitionStruct SectionDefinition;
 
@@ -116,6 +190,7 @@ private:
     string currentSection;
 
     unsigned int sectionCounter;
+    vector<int> sectionSymbols; // section ndx -> the section's symbol
 
 
     /**
@@ -155,10 +230,11 @@ public:
 
         // init section counter
         this->sectionCounter = 0;
+        this->messages = &std::cout;
+        this->sectionSymbols.push_back(-1);
 
         // init symbol table
-        SymbolTableRow* s = new SymbolTableRow(0, 0, 0, NOTYP, LOC, UND, "", false);
-        this->symbolTable.push_back(s);
+        this->symbolTable.push_back(SymbolTableRow(0, 0, 0, NOTYP, LOC, UND, "", false));
 
     }
 
@@ -169,19 +245,20 @@ public:
     void word(vector<string> params); // not implemented
     void skip(string param);
     void ascii(string param);
-    void equ(); // not implemented
+    void equ(vector<string> params);
+    void ltorg();
     void end();
 
     // Instructions.
     void halt();
     void intI();
     void iret();
-    void call(string param);
+    void call(Operand target);
     void ret();
-    void jmp(string param);
-    void beq(vector<string> params);
-    void bne(vector<string> params);
-    void bgt(vector<string> params);
+    void jmp(Operand target);
+    void beq(int gpr1, int gpr2, Operand target);
+    void bne(int gpr1, int gpr2, Operand target);
+    void bgt(int gpr1, int gpr2, Operand target);
     void push(string param);
     void pop(string param);
     void xchg(vector<string> params);
@@ -195,8 +272,8 @@ public:
     void xorI(vector<string> params);
     void shl(vector<string> params);
     void shr(vector<string> params);
-    void ld(vector<string> params);
-    void st(vector<string> params);
+    void ld(Operand source, int gpr);
+    void st(int gpr, Operand destination);
     void csrrd(vector<string> params);
     void csrwr(vector<string> params);
 
@@ -206,6 +283,12 @@ public:
     void noOp(){ locationCounter += 4; }
 
     void set_output_file(char* name);
+    void set_messages(ostream* stream){ messages = stream; }
+    ostream& get_messages(){ return *messages; }
+
+    // parser side: operands and registers are decoded once, here
+    Operand make_operand(OperandKind kind, const Token* reg, const Token* literal, const Token* symbol);
+    int general_register_string_to_index(string param);
 
     ~Assembler(){
 
@@ -214,20 +297,12 @@ public:
             delete pair.second;
         }
 
-        // delete symbol table.
-        for(SymbolTableRow* s: symbolTable){
-            delete s;
-        }
-
-        // delete relocation table.
-        for (const auto& pair : relocationTables) {
-            int section = pair.first;
-            vector<RelocationTableRow*> row = pair.second;
-            for(RelocationTableRow* r: row){
-                delete r;
-            }
+        // delete equ table.
+        for(const auto& pair: equTable){
+            delete pair.second;
         }
 
+        // flink and relocation rows are in the arena.
     }
 private:
     void generate_relocation_tables();
@@ -242,9 +317,25 @@ private:
     string operationToString(Operation op);
     int literal_to_int(string param);
     void insert_word_into_machine_code(int value);
-    int general_register_string_to_index(string param);
+    bool evaluate_expression(vector<string>& expression, ExpressionValue& result, int& missing);
+    bool is_absolute(ExpressionValue& value);
+    int section_symbol(int ndx);
+    void resolve_equ(int symbol);
+    void symbol_defined(int symbol);
     int system_register_string_to_index(string param);
-    void push_to_flink(string param, int symbolValue, int address, Operation operation, bool st8Relocation);
+    void push_to_flink(int symbol, int symbolValue, int address, Operation operation, bool st8Relocation);
+    LiteralPoolEntry literal_pool_constant(int value);
+    LiteralPoolEntry literal_pool_symbol(int symbol);
+    LiteralPoolEntry branch_target(Operand target);
+    int intern_symbol(string name);
+    bool is_small_constant(LiteralPoolEntry entry);
+    void insert_literal_pool_instruction(int insCode, LiteralPoolEntry entry);
+    void add_literal_pool_reference(uint32_t address, LiteralPoolEntry entry);
+    void insert_branch_instruction(int shortInsCode, int longInsCode, LiteralPoolEntry target);
+    void resolve_branches(int label);
+    void grow_branch(Branch branch);
+    void reserve_literal_pool_range(int bytes);
+    void place_literal_pool(bool jumpOver);
     void write_to_file_4bytes_little_endian(ofstream& ostream, Elf32_Word value);
     void print_elf(string fileName);
 };
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+
+/**
+ * Simulated set associative cache with LRU replacement.
+ * 
+ * Only used for analysis: it does not hold data, it only tracks tags and
+ * counts hits and misses per guest PC that caused the access.
+ */
+class CacheModel{
+private:
+    std::string name;
+
+    uint32_t size;
+    uint32_t associativity;
+    uint32_t lineSize;
+    uint32_t numberOfSets;
+
+    uint32_t offsetBits;
+    uint32_t setBits;
+
+    struct CacheLineStruct{
+        bool valid;
+        uint32_t tag;
+        uint64_t lastUse;
+    };
+    typedef CacheLineStruct CacheLine;
+
+    // numberOfSets * associativity lines, ways of one set are next to each other.
+    std::vector<CacheLine> lines;
+
+    uint64_t useCounter;
+
+    struct CacheCounterStruct{
+        uint64_t hits;
+        uint64_t misses;
+
+        CacheCounterStruct(): hits(0), misses(0) {}
+    };
+    typedef CacheCounterStruct CacheCounter;
+
+    CacheCounter total;
+    std::unordered_map<uint32_t, CacheCounter> perPc;
+
+public:
+    CacheModel(std::string name, uint32_t size, uint32_t associativity, uint32_t lineSize);
+
+    bool access(uint32_t address, uint32_t pc);
+
+    void report(std::ostream& out, std::function<std::string(uint32_t)> symbolize);
+
+    static bool is_valid_config(uint32_t size, uint32_t associativity, uint32_t lineSize);
+
+private:
+    static uint32_t log2(uint32_t value);
+};
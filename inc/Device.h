@@ -0,0 +1,124 @@
+#include <coroutine>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <exception>
+#include <cstdint>
+
+#define NO_TIMEOUT 0
+
+/**
+ * Emulated devices are coroutines that run on the cpu thread:
+ *
+ *   DeviceTask Emulator::block_device()
+ *   {
+ *       while(true){
+ *           RegisterWrite command = co_await devices.register_write(BLOCK_COMMAND_REG_ADDRESS);
+ *           ...
+ *           co_await devices.delay(BLOCK_LATENCY);
+ *           ...
+ *       }
+ *   }
+ *
+ * A device runs from start until its first co_await. A register write resumes the device
+ * waiting for it from inside the store instruction, a delay resumes it from the virtual clock
+ * scheduler of the cpu loop. Nothing runs and nothing is polled between those events.
+ */
+
+/**
+ * What a device waiting for a register got: the value written to it, or nothing (written is
+ * false) when the timeout came first.
+ */
+struct RegisterWriteStruct{
+    bool written;
+    uint32_t value;
+};
+typedef RegisterWriteStruct RegisterWrite;
+
+class DeviceTask{
+public:
+    struct promise_type{
+        DeviceTask get_return_object(){ return DeviceTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void(){}
+        void unhandled_exception(){ std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+public:
+    explicit DeviceTask(std::coroutine_handle<promise_type> handle): handle(handle) {}
+    DeviceTask(DeviceTask&& other) noexcept: handle(other.handle) { other.handle = nullptr; }
+    DeviceTask(const DeviceTask&) = delete;
+    DeviceTask& operator=(const DeviceTask&) = delete;
+
+    ~DeviceTask(){
+        if(handle){
+            handle.destroy();
+        }
+    }
+};
+
+class DeviceScheduler{
+public:
+    typedef std::function<void(uint64_t delay, std::function<void()> action)> ScheduleFunction;
+
+    struct DelayAwaiter{
+        DeviceScheduler* scheduler;
+        uint64_t ticks;
+
+        bool await_ready(){ return ticks == 0; }
+        void await_suspend(std::coroutine_handle<> handle){ scheduler->resume_after(ticks, handle); }
+        void await_resume(){}
+    };
+
+    struct RegisterWriteAwaiter{
+        DeviceScheduler* scheduler;
+        uint32_t address;
+        uint64_t timeout;
+        RegisterWrite result;
+
+        bool await_ready(){ return false; }
+        void await_suspend(std::coroutine_handle<> handle){ scheduler->wait_for_write(address, timeout, handle, &result); }
+        RegisterWrite await_resume(){ return result; }
+    };
+
+private:
+    struct WaiterStruct{
+        std::coroutine_handle<> handle;
+        RegisterWrite* result;
+        uint64_t id;
+    };
+    typedef WaiterStruct Waiter;
+
+    ScheduleFunction schedule;
+    std::unordered_map<uint32_t, Waiter> waiters; // register address -> the device waiting for a write to it
+    std::vector<DeviceTask> tasks;
+    uint64_t nextWaitId;
+    uint64_t generation; // scheduled resumes of devices destroyed by reset are dropped
+
+    void resume_after(uint64_t ticks, std::coroutine_handle<> handle);
+    void wait_for_write(uint32_t address, uint64_t timeout, std::coroutine_handle<> handle, RegisterWrite* result);
+
+public:
+    DeviceScheduler(ScheduleFunction schedule): schedule(schedule), nextWaitId(0), generation(0) {}
+
+    void start(DeviceTask task){ tasks.push_back(std::move(task)); }
+    void reset();
+
+    DelayAwaiter delay(uint64_t ticks){ return { this, ticks }; }
+    RegisterWriteAwaiter register_write(uint32_t address, uint64_t timeout = NO_TIMEOUT){ return { this, address, timeout, { false, 0 } }; }
+
+    // the cpu wrote a device register, false if no device was waiting for it
+    bool written(uint32_t address, uint32_t value){
+        if(waiters.empty()){
+            return false;
+        }
+        return resume_waiter(address, value);
+    }
+
+private:
+    bool resume_waiter(uint32_t address, uint32_t value);
+};
@@ -10,6 +10,46 @@
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
+#include <vector>
+#include <fcntl.h>
+#include <queue>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+
+#include "InterruptController.h"
+#include "TraceRecorder.h"
+#include "SpscQueue.h"
+#include "Device.h"
+#include "GuestMemory.h"
+
+#ifdef CACHE_MODEL
+#include "CacheModel.h"
+#endif
+
+// --perf: guest pc sampled on SIGPROF
+#define PERF_SAMPLE_INTERVAL 1000 // microseconds of cpu time
+#define PERF_MAX_SAMPLES (1 << 20)
+
+// in-process fuzzing (src/Fuzzer.cpp)
+#define FUZZ_INSTRUCTION_BUDGET 1000000 // per input
+#define FUZZ_INPUT_INTERVAL 100 // virtual clock ticks between two characters of the input
+
+// edge coverage of guest branches
+#ifdef EMULATOR_FUZZER
+#define FUZZ_MAP_SIZE 65536 // same as the AFL shared memory bitmap
+
+extern uint8_t* fuzzCoverageMap;
+#endif
 
 #define EXECUTE_START_ADDRESS 0x40000000
 #define STATUS_REG_INDEX 0
@@ -18,33 +58,190 @@
 #define MEMORY_MAPPED_REGISTER_START_ADDRESS 0xFFFFFF00
 #define TERM_OUT_REG_ADDRESS 0xFFFFFF00
 #define TERM_IN_REG_ADDRESS 0xFFFFFF04
+#define TIM_CFG_REG_ADDRESS 0xFFFFFF10
+
+#define INPUT_QUEUE_SIZE 256 // characters read from stdin the cpu did not take yet
+
+// timer: tim_cfg selects the period, the timer starts with the first write to tim_cfg
+#define TIMER_PERIODS { 500, 1000, 1500, 2000, 5000, 10000, 30000, 60000 } // milliseconds
+#define TIMER_TICKS_PER_MILLISECOND 1000 // virtual clock ticks, when there is no host I/O thread (fuzzing)
+
+// --memory-stats
+#define PAGE_FETCHED 0x1 // an instruction was executed from the page
+#define PAGE_READ 0x2
+#define PAGE_WRITTEN 0x4
+#define STACK_SWITCH_DISTANCE 0x100000 // sp moving further than this from a stack is on another stack
+
+// semihosting device: writing an operation into SEMIHOST_OP starts the host call
+#define SEMIHOST_OP_REG_ADDRESS 0xFFFFFF20
+#define SEMIHOST_PTR_REG_ADDRESS 0xFFFFFF24
+#define SEMIHOST_LEN_REG_ADDRESS 0xFFFFFF28
+#define SEMIHOST_FD_REG_ADDRESS 0xFFFFFF2C
+#define SEMIHOST_RESULT_REG_ADDRESS 0xFFFFFF30 // fd / number of bytes / 0, 0xFFFFFFFF on error
+
+#define SEMIHOST_OPEN_READ 1 // path = mem[ptr .. ptr + len), relative to the sandbox directory
+#define SEMIHOST_OPEN_WRITE 2 // creates or truncates the file
+#define SEMIHOST_READ 3 // fd, mem[ptr .. ptr + len) <= file
+#define SEMIHOST_WRITE 4 // fd, file <= mem[ptr .. ptr + len)
+#define SEMIHOST_CLOSE 5 // fd
+
+#define SEMIHOST_ERROR 0xFFFFFFFF
+#define SEMIHOST_MAX_OPEN_FILES 16
+#define SEMIHOST_MAX_PATH 4096
+#define SEMIHOST_MAX_TRANSFER 0x4000000 // 64MB per call
+
+// block device: writing a command into BLOCK_COMMAND starts the transfer, completion raises CAUSE_BLOCK
+#define BLOCK_SECTOR_REG_ADDRESS 0xFFFFFF40
+#define BLOCK_BUFFER_REG_ADDRESS 0xFFFFFF44
+#define BLOCK_COUNT_REG_ADDRESS 0xFFFFFF48
+#define BLOCK_COMMAND_REG_ADDRESS 0xFFFFFF4C
+#define BLOCK_STATUS_REG_ADDRESS 0xFFFFFF50
+
+#define BLOCK_COMMAND_READ 1 // mem[buffer ..] <= disk[sector .. sector + count)
+#define BLOCK_COMMAND_WRITE 2 // disk[sector .. sector + count) <= mem[buffer ..]
+
+#define BLOCK_STATUS_DONE 0
+#define BLOCK_STATUS_BUSY 1
+#define BLOCK_STATUS_ERROR 2
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_LATENCY 1000 // virtual clock ticks (instructions) per command
+#define BLOCK_LATENCY_PER_SECTOR 50
 #define BYTE_0 0
 #define BYTE_1 1
 #define BYTE_2 2
 #define BYTE_3 3
 #define WORD_SIZE 4
 
-#define TIMER_BIT 0 // Tr (Timer) - maskiranje prekida od tajmera (0 - omogućen, 1 - maskiran)
-#define TERMINAL_BIT 1 // Tl (Terminal) - maskiranje prekida od terminala (0 - omogućen, 1 - maskiran) 
-#define INTERRUPT_BIT 2 // I (Interrupt) - globalno maskiranje spoljašnjih prekida (0 - omogućeni, 1 - maskirani)
-
 #define PC_INDEX 15
 #define SP_INDEX 14
 
 #define SP_DEFAULT_VALUE 0x20000000
+
+// default L1 configuration of the cache model: size, associativity, line size
+#define CACHE_DEFAULT_SIZE 4096
+#define CACHE_DEFAULT_ASSOCIATIVITY 2
+#define CACHE_DEFAULT_LINE_SIZE 32
+
+struct CacheConfigStruct{
+    uint32_t size;
+    uint32_t associativity;
+    uint32_t lineSize;
+
+    CacheConfigStruct(): size(CACHE_DEFAULT_SIZE), associativity(CACHE_DEFAULT_ASSOCIATIVITY), lineSize(CACHE_DEFAULT_LINE_SIZE) {}
+};
+typedef CacheConfigStruct CacheConfig;
+
+/**
+ * Command line options of the emulator.
+ */
+struct EmulatorOptionsStruct{
+    std::string symbolMapFile; // --map=<file>, generated by the linker with -map=<file>
+
+    CacheConfig instructionCache; // --icache=<size>,<associativity>,<line size>
+    CacheConfig dataCache; // --dcache=<size>,<associativity>,<line size>
+
+    std::string semihostDirectory; // --semihost=<dir>, semihosting is disabled without it
+
+    std::string diskImage; // --disk=<file>, block device is disabled without it
+
+    bool predecode; // --predecode, decoded instructions are kept until the guest overwrites them
+    bool lockstep; // --lockstep, predecode checked against the reference interpreter after every block
+
+    std::string traceFile; // --trace=<file>, binary instruction trace (see TraceRecorder.h)
+
+    bool perf; // --perf, /tmp/perf-<pid>.map for translated code and guest pc sampling
+
+    bool interruptStats; // --interrupt-stats, interrupt latency and handler duration per cause
+
+    bool memoryStats; // --memory-stats, stack depth, touched pages per region and resident memory
+
+    EmulatorOptionsStruct(): predecode(false), lockstep(false), perf(false), interruptStats(false), memoryStats(false) {}
+};
+typedef EmulatorOptionsStruct EmulatorOptions;
+
+class Emulator;
+
+/**
+ * Ahead-of-time translated guest code (generated by the translator, see Translator.h).
+ * The generated source registers itself before main, the emulator then runs translated 
+ * blocks whenever pc is in one and falls back to interpretation otherwise.
+ */
+struct TranslatedCodeStruct{
+    uint32_t (*run)(Emulator& emu); // runs from the current pc, returns the pc it can not continue from
+    bool (*verify)(Emulator& emu); // checks that the loaded image is the one that was translated
+    const uint32_t* addresses; // translated instruction words
+    const uint32_t* blocks; // block of each translated instruction word
+    int numberOfAddresses;
+    int numberOfBlocks;
+};
+typedef TranslatedCodeStruct TranslatedCode;
+
 class Emulator{
 private:
+    friend class TranslatedProgram;
 
-    // terminal 
-    std::thread terminal;
-    bool ready;
-    std::mutex mtx;                      // Mutex for synchronizing access
-    std::condition_variable cv;        // Condition variable
+    // host I/O thread: one epoll loop for stdin, terminal output, the wall clock timer and shutdown
+    std::thread io;
+    int epollFd;
+    int wakeFd; // eventfd: shutdown, or room in the input queue again
+    int timerFd; // timerfd of the wall clock timer
+    int outputPipe[2]; // term_out: the cpu writes, the I/O thread copies to stdout
     std::atomic<bool> stopFlag;
+    std::atomic<bool> inputBlocked; // the I/O thread stopped reading stdin because the input queue is full
+    SpscQueue<unsigned char, INPUT_QUEUE_SIZE> inputQueue; // I/O thread -> cpu
+    std::atomic<uint32_t> terminalInput; // character in term_in until the cpu takes the next one
+    bool terminalLatched; // the fuzzer put a character in terminalInput that was not delivered yet
+
+    InterruptController interruptController;
 
 
     std::string inputFileName;
-    std::map<int, unsigned char> memory;
+    EmulatorOptions options;
+    GuestMemory memory;
+
+    // guest symbols: address -> name
+    std::map<uint32_t, std::string> symbolMap;
+
+    // semihosting: sandbox directory and guest fd -> host fd
+    int semihostDirectoryFd;
+    std::map<uint32_t, int> semihostFiles;
+    uint32_t semihostNextFd;
+
+    // virtual clock: number of executed instructions
+    uint64_t virtualClock;
+
+    struct ScheduledEventStruct{
+        uint64_t time;
+        std::function<void()> action;
+
+        bool operator>(const ScheduledEventStruct& other) const { return time > other.time; }
+    };
+    typedef ScheduledEventStruct ScheduledEvent;
+
+    std::priority_queue<ScheduledEvent, std::vector<ScheduledEvent>, std::greater<ScheduledEvent>> scheduledEvents;
+    uint64_t nextEventTime;
+
+    // emulated devices, coroutines resumed by register writes and by the virtual clock (see Device.h)
+    DeviceScheduler devices;
+
+    // block device: image mapped into the emulator
+    unsigned char* diskData;
+    uint64_t diskSize;
+
+    // ahead-of-time translated code, if it was linked in
+    static TranslatedCode* translatedCodeRegistry;
+    TranslatedCode* translatedCode;
+    std::unordered_map<uint32_t, uint32_t> translatedWords; // instruction address -> block
+    std::vector<char> invalidBlocks; // blocks whose instructions were overwritten by the guest
+    bool codeModified;
+    bool describeTranslatedCode; // run only reports translatedBlockStarts
+    const void* const* translatedBlockStarts; // host address of every block, then the end of the code
+
+#ifdef CACHE_MODEL
+    CacheModel* instructionCache;
+    CacheModel* dataCache;
+#endif
 
     uint32_t gprx[16];
     uint32_t csr[3];
@@ -61,20 +258,168 @@ private:
     typedef InstructionStruct Instruction;
 
     Instruction currentInstruction;
+    uint32_t currentInstructionAddress;
+
+    // loaded image, shared by the instances of this process that loaded the same file
+    struct SharedImageStruct{
+        std::vector<std::pair<uint32_t, std::unique_ptr<unsigned char[]>>> pages; // page address, contents
+        std::vector<std::vector<Instruction>> decoded; // every word of every page, decoded
+    };
+    typedef SharedImageStruct SharedImage;
+
+    static std::mutex sharedImagesMutex;
+    static std::map<std::string, std::weak_ptr<SharedImage>> sharedImages;
+    std::shared_ptr<SharedImage> image;
+
+    // predecode engine: decoded instructions by (word aligned) address
+    std::unordered_map<uint32_t, Instruction> predecoded;
+
+    // lockstep: a second instance without devices runs the reference interpreter next to this one
+    struct DeviceWriteStruct{
+        uint64_t time; // virtual time from which the cpu sees the data
+        uint32_t address;
+        std::vector<unsigned char> data;
+    };
+    typedef DeviceWriteStruct DeviceWrite;
+
+    bool devicesEnabled;
+    bool halted;
+    bool executingInstruction;
+    uint32_t takenInterrupt; // cause entered at the end of the last block, 0 if none
+    std::vector<uint32_t> writtenAddresses; // cpu stores of the current block
+    std::vector<DeviceWrite> deviceWrites; // device writes of the current block
+
+    // fuzzing: the state after loading is restored before every input
+    struct UndoRecordStruct{
+        uint32_t address;
+        unsigned char oldValue;
+    };
+    typedef UndoRecordStruct UndoRecord;
+
+    bool fuzzing;
+    std::vector<UndoRecord> undoLog;
+    uint32_t snapshotGprx[16];
+    uint32_t snapshotCsr[3];
+    const uint8_t* fuzzInput;
+    size_t fuzzInputSize;
+    size_t fuzzInputPosition;
+    uint64_t fuzzEndTime;
+    uint32_t previousLocation;
+
+    // instruction trace, if one is recorded
+    TraceRecorder* trace;
+
+    // --perf: samples written by the SIGPROF handler
+    static volatile uint32_t* sampledPc;
+    static uint32_t* samples;
+    static std::atomic<uint32_t> numberOfSamples;
+
+    // --interrupt-stats: latency is measured from the raise to the handler entry, in instructions
+    // from the first block end that saw the interrupt pending and in wall clock time from the raise.
+    // A handler ends when pc is loaded from the word its entry pushed pc to (iret).
+    struct InterruptFrameStruct{
+        uint32_t cause;
+        uint32_t frameAddress; // where the entry pushed pc
+        uint64_t entryTime;
+        uint64_t entryNanoseconds;
+    };
+    typedef InterruptFrameStruct InterruptFrame;
+
+    struct InterruptTimingStruct{
+        LatencyHistogram latency;
+        LatencyHistogram latencyNanoseconds;
+        LatencyHistogram duration;
+        LatencyHistogram durationNanoseconds;
+    };
+    typedef InterruptTimingStruct InterruptTiming;
+
+    std::map<uint32_t, InterruptTiming> interruptTimings;
+    std::vector<InterruptFrame> interruptFrames; // handlers entered and not returned from, innermost last
+    uint64_t pendingSince[NUMBER_OF_CAUSES]; // virtual time an interrupt was first seen pending
+    uint32_t pendingSeen; // causes with a valid pendingSince
+
+    // --memory-stats: how every page was used, and every stack sp was seen on
+    struct StackStruct{
+        uint32_t top; // highest sp seen on this stack
+        uint32_t lowest; // lowest sp seen on this stack
+    };
+    typedef StackStruct Stack;
+
+    std::vector<unsigned char> pageUse; // PAGE_FETCHED | PAGE_READ | PAGE_WRITTEN, by page number
+    std::vector<Stack> stacks;
+    uint32_t lastSp;
 public:
-    Emulator(std::string inputFileName): inputFileName(inputFileName), ready(true) {
+    Emulator(std::string inputFileName, EmulatorOptions options): inputFileName(inputFileName), options(options),
+        devices([this](uint64_t delay, std::function<void()> action){ schedule(delay, action); }) {
+        epollFd = -1;
+        wakeFd = -1;
+        timerFd = -1;
+        outputPipe[0] = -1;
+        outputPipe[1] = -1;
         stopFlag.store(false);
+        inputBlocked.store(false);
+        terminalInput.store(0);
+        terminalLatched = false;
+        currentInstructionAddress = EXECUTE_START_ADDRESS;
+        semihostDirectoryFd = -1;
+        semihostNextFd = 3;
+        virtualClock = 0;
+        nextEventTime = UINT64_MAX;
+        diskData = nullptr;
+        diskSize = 0;
+        translatedCode = nullptr;
+        codeModified = false;
+        describeTranslatedCode = false;
+        translatedBlockStarts = nullptr;
+        devicesEnabled = true;
+        halted = false;
+        executingInstruction = false;
+        takenInterrupt = 0;
+        fuzzing = false;
+        fuzzInput = nullptr;
+        fuzzInputSize = 0;
+        fuzzInputPosition = 0;
+        fuzzEndTime = UINT64_MAX;
+        previousLocation = 0;
+        trace = nullptr;
+        pendingSeen = 0;
+        lastSp = 0;
+
+#ifdef CACHE_MODEL
+        instructionCache = new CacheModel("L1I", options.instructionCache.size, options.instructionCache.associativity, options.instructionCache.lineSize);
+        dataCache = new CacheModel("L1D", options.dataCache.size, options.dataCache.associativity, options.dataCache.lineSize);
+#endif
+    }
+
+    ~Emulator(){
+#ifdef CACHE_MODEL
+        delete instructionCache;
+        delete dataCache;
+#endif
     }
 
     void powerOn();
 
+    static void register_translated_code(TranslatedCode* code){ translatedCodeRegistry = code; }
+
+    void fuzz_init();
+    void fuzz_one_input(const uint8_t* data, size_t size);
+
 private:
     void init_hardware();
     void init_memory();
+    static std::shared_ptr<SharedImage> load_shared_image(std::string fileName);
+    void init_symbol_map();
+    std::string symbolize(uint32_t address);
     void run();
+    bool step();
     void decode_and_execute(Instruction instruction);
 
+    void run_lockstep();
+    void lockstep_compare(Emulator* reference, uint32_t blockAddress);
+
     void halt();
+    void power_off();
 
     void error_print_and_exit(std::string errorMessage);
 
@@ -91,9 +436,52 @@ private:
 
     void memory_set_word(uint32_t address, uint32_t value);
     uint32_t memory_get_word(uint32_t address);
+    void device_set_word(uint32_t address, uint32_t value);
+    bool memory_peek_word(uint32_t address, uint32_t& value);
+    void invalidate_code(uint32_t address, uint32_t length);
+
+    void undo_log_record(uint32_t address, uint32_t length);
+    void fuzz_restore();
+    void fuzz_deliver_input();
+    void fuzz_edge(uint32_t target){
+#ifdef EMULATOR_FUZZER
+        uint32_t location = (target * 0x9E3779B1u) >> 16;
+        fuzzCoverageMap[(location ^ previousLocation) % FUZZ_MAP_SIZE]++;
+        previousLocation = location >> 1;
+#endif
+    }
+    bool memory_read_block(uint32_t address, unsigned char* buffer, uint32_t length);
+    bool memory_write_block(uint32_t address, const unsigned char* buffer, uint32_t length);
+
+    void mmio_write(uint32_t address, uint32_t value);
 
     void interruption();
+    void interrupt_enter(uint32_t cause);
+    void interrupt_check();
+    void interrupt_pending_seen();
+    void interrupt_return(uint32_t address){
+        if(!interruptFrames.empty()){
+            interrupt_return_check(address);
+        }
+    }
+    void interrupt_return_check(uint32_t address);
+    void print_interrupt_statistics();
+
+    void page_used(uint32_t address, unsigned char use){
+        if(options.memoryStats){
+            pageUse[address >> PAGE_BITS] |= use;
+        }
+    }
+    void sp_seen(uint32_t sp){
+        if(options.memoryStats && sp != lastSp){
+            stack_update(sp);
+        }
+    }
+    void stack_update(uint32_t sp);
+    void print_memory_statistics();
     Instruction get_instruction();
+    static Instruction decode(uint32_t instruction);
+    Instruction get_predecoded_instruction();
 
     void set_term_out(uint32_t value);
     uint32_t get_term_out();
@@ -101,31 +489,134 @@ private:
     void set_term_in(uint32_t value);
     uint32_t get_term_in();
 
-    void terminal_check();
-
     void print_end_state();
+    void print_statistics();
 
     void disable_echo();
     void enable_echo();
-    void terminal_thread_function();
+    void init_io();
+    void stop_io();
+    void io_thread_function();
+    bool io_read_input();
+    void io_copy_output();
+    void wake_io();
+
+    void start_devices();
+    DeviceTask terminal_output_device();
+    DeviceTask timer_device();
+    DeviceTask semihost_device();
+    DeviceTask block_device();
+
+    void schedule(uint64_t delay, std::function<void()> action);
+    void run_scheduled_events();
+
+    void init_translated_code();
+    void init_trace();
+
+    void init_perf();
+    void write_perf_map();
+    void print_samples();
+    static void sample_handler(int signal);
+    void invalidate_translated_word(uint32_t address);
+
+    void init_block_device();
+
+    void init_semihosting();
+    void semihost_call(uint32_t operation);
+    int semihost_open(std::string path, int flags);
 
     void my_exit();
 };
 
+// EMULATOR_LIBRARY: build without main, to be linked with translated code that brings its own.
+// EMULATOR_FUZZER: the fuzzing engine brings main.
+#if !defined(EMULATOR_LIBRARY) && !defined(EMULATOR_FUZZER)
+bool parse_cache_config(std::string value, CacheConfig& config)
+{
+    std::stringstream ss(value);
+    std::string field;
+    uint32_t fields[3];
+    int count = 0;
+
+    while(std::getline(ss, field, ',')){
+        if(count == 3){
+            return false;
+        }
+        try{
+            fields[count++] = std::stoul(field, nullptr, 0);
+        } catch(...){
+            return false;
+        }
+    }
+
+    if(count != 3){
+        return false;
+    }
+
+    config.size = fields[0];
+    config.associativity = fields[1];
+    config.lineSize = fields[2];
+    return true;
+}
+
 int main(int argc, char* argv[]) {
-    // Check if the correct number of arguments is passed
-    if (argc != 2) {
-        std::cerr << "Linker: ERROR -> Usage: " << argv[0] << " <filename>\n";
-        return 1;  // Return with error code
+    EmulatorOptions options;
+    std::string filename;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--map=", 0) == 0) {
+            options.symbolMapFile = arg.substr(6);
+        } else if (arg.rfind("--icache=", 0) == 0 || arg.rfind("--dcache=", 0) == 0) {
+            CacheConfig& config = arg[2] == 'i' ? options.instructionCache : options.dataCache;
+            if (!parse_cache_config(arg.substr(9), config)) {
+                std::cerr << "Emulator: ERROR -> expected " << arg.substr(0, 9) << "<size>,<associativity>,<line size>\n";
+                return 1;
+            }
+#ifdef CACHE_MODEL
+            if (!CacheModel::is_valid_config(config.size, config.associativity, config.lineSize)) {
+                std::cerr << "Emulator: ERROR -> cache parameters must be powers of two and size >= associativity * line size\n";
+                return 1;
+            }
+#else
+            std::cerr << "Emulator: Warning -> built without CACHE_MODEL, " << arg.substr(0, 8) << " ignored\n";
+#endif
+        } else if (arg.rfind("--disk=", 0) == 0) {
+            options.diskImage = arg.substr(7);
+        } else if (arg.rfind("--semihost=", 0) == 0) {
+            options.semihostDirectory = arg.substr(11);
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            options.traceFile = arg.substr(8);
+        } else if (arg == "--perf") {
+            options.perf = true;
+        } else if (arg == "--interrupt-stats") {
+            options.interruptStats = true;
+        } else if (arg == "--memory-stats") {
+            options.memoryStats = true;
+        } else if (arg == "--predecode") {
+            options.predecode = true;
+        } else if (arg == "--lockstep") {
+            options.lockstep = true;
+        } else if (arg[0] != '-' && filename.empty()) {
+            filename = arg;
+        } else {
+            std::cerr << "Emulator: ERROR -> unknown option " << arg << "\n";
+            return 1;
+        }
     }
 
-    // Catch the file name argument
-    std::string filename = argv[1];
+    // Check if the input file is passed
+    if (filename.empty()) {
+        std::cerr << "Emulator: ERROR -> Usage: " << argv[0] << " [options] <filename>\n";
+        return 1;  // Return with error code
+    }
 
-    Emulator emu(filename);
+    Emulator emu(filename, options);
 
     emu.powerOn();
 
     
     return 0;  // Return success code
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
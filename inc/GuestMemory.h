@@ -0,0 +1,106 @@
+#include <cstdint>
+#include <cstring>
+
+#define PAGE_BITS 12
+#define PAGE_SIZE (1u << PAGE_BITS)
+#define PAGE_TABLE_BITS 10 // pages per second level table: 1024 pages, 4MB of guest memory
+#define PAGE_DIRECTORY_SIZE (1u << (32 - PAGE_BITS - PAGE_TABLE_BITS))
+
+/**
+ * Guest memory: 4KB pages in a two level page table, both levels allocated on first touch.
+ * Memory that was never written reads as 0.
+ *
+ * Pages of the loaded image are mapped read-only from an image shared by every instance
+ * that loaded it (the owner keeps it alive). The first store into such a page copies it
+ * (copy on write), from then on the page is private to this instance.
+ */
+class GuestMemory{
+private:
+    struct PageEntryStruct{
+        const unsigned char* read; // null while the page was never touched
+        unsigned char* write; // null while the page is shared
+        int32_t sharedIndex; // index of the page in the shared image, -1 for private pages
+    };
+    typedef PageEntryStruct PageEntry;
+
+    struct PageTableStruct{
+        PageEntry entries[1 << PAGE_TABLE_BITS];
+    };
+    typedef PageTableStruct PageTable;
+
+    PageTable* directory[PAGE_DIRECTORY_SIZE];
+
+    uint32_t privatePages;
+    uint32_t sharedPages;
+    uint32_t copiedPages; // shared pages the guest stored into
+
+    PageEntry* find_entry(uint32_t address){
+        PageTable* table = directory[address >> (PAGE_BITS + PAGE_TABLE_BITS)];
+        return table == nullptr ? nullptr : &table->entries[(address >> PAGE_BITS) & ((1 << PAGE_TABLE_BITS) - 1)];
+    }
+    PageEntry* create_entry(uint32_t address);
+    unsigned char* private_page(uint32_t address);
+
+public:
+    GuestMemory();
+    ~GuestMemory();
+    GuestMemory(const GuestMemory&) = delete;
+    GuestMemory& operator=(const GuestMemory&) = delete;
+
+    void map_shared(uint32_t address, const unsigned char* data, int32_t sharedIndex);
+    void clear();
+
+    unsigned char read_byte(uint32_t address){
+        PageEntry* entry = find_entry(address);
+        return entry == nullptr || entry->read == nullptr ? 0 : entry->read[address & (PAGE_SIZE - 1)];
+    }
+
+    void write_byte(uint32_t address, unsigned char value){
+        PageEntry* entry = find_entry(address);
+        unsigned char* page = entry != nullptr && entry->write != nullptr ? entry->write : private_page(address);
+        page[address & (PAGE_SIZE - 1)] = value;
+    }
+
+    // little endian, a word may cross a page boundary
+    uint32_t read_word(uint32_t address){
+        PageEntry* entry = find_entry(address);
+        uint32_t offset = address & (PAGE_SIZE - 1);
+
+        if(entry != nullptr && entry->read != nullptr && offset <= PAGE_SIZE - 4){
+            uint32_t value;
+            memcpy(&value, entry->read + offset, 4);
+            return value;
+        }
+
+        return read_byte(address) | (read_byte(address + 1) << 8) | (read_byte(address + 2) << 16) | ((uint32_t)read_byte(address + 3) << 24);
+    }
+
+    void write_word(uint32_t address, uint32_t value){
+        PageEntry* entry = find_entry(address);
+        uint32_t offset = address & (PAGE_SIZE - 1);
+
+        if(entry != nullptr && entry->write != nullptr && offset <= PAGE_SIZE - 4){
+            memcpy(entry->write + offset, &value, 4);
+            return;
+        }
+
+        for(uint32_t i = 0; i < 4; i ++){
+            write_byte(address + i, value >> (i * 8));
+        }
+    }
+
+    bool is_mapped(uint32_t address){
+        PageEntry* entry = find_entry(address);
+        return entry != nullptr && entry->read != nullptr;
+    }
+
+    // index of the page in the shared image, -1 if the page is private (or not there)
+    int32_t shared_index(uint32_t address){
+        PageEntry* entry = find_entry(address);
+        return entry == nullptr ? -1 : entry->sharedIndex;
+    }
+
+    uint32_t get_private_pages(){ return privatePages; }
+    uint32_t get_shared_pages(){ return sharedPages; }
+    uint32_t get_copied_pages(){ return copiedPages; }
+};
@@ -1,10 +1,4 @@
-
-#include <stdarg.h>
-
-
-// extern "C" void proc_instruction(char* name, ...);
-// extern "C" void push_back_list(char* arg);
-// extern "C" void clear_list();
+#include <stddef.h>
 
 enum Instruction{
     GLOBAL,
@@ -14,6 +8,7 @@ enum Instruction{
     SKIP,
     ASCII,
     EQU,
+    LTORG,
     END,
     HALT,
     INT,
@@ -43,3 +38,79 @@ enum Instruction{
     CSRWR,
     LABEL
 };
+
+/**
+ * Operand of ld, st, call, jmp and the branches, built once by the parser.
+ */
+enum OperandKind{
+    OPERAND_IMMEDIATE_LITERAL, // $literal
+    OPERAND_IMMEDIATE_SYMBOL, // $symbol
+    OPERAND_MEMORY_LITERAL, // literal
+    OPERAND_MEMORY_SYMBOL, // symbol
+    OPERAND_REGISTER, // %reg
+    OPERAND_REGISTER_INDIRECT, // [%reg]
+    OPERAND_REGISTER_LITERAL, // [%reg + literal]
+    OPERAND_REGISTER_SYMBOL // [%reg + symbol]
+};
+
+struct OperandStruct{
+    enum OperandKind kind;
+    int reg; // general register index
+    int literal;
+    int symbol; // interned symbol id
+};
+typedef struct OperandStruct Operand;
+
+/**
+ * Token text as the scanner found it: a view into the source buffer, not null terminated.
+ * Valid until the file is assembled.
+ */
+struct TokenStruct{
+    const char* text;
+    int length;
+};
+typedef struct TokenStruct Token;
+
+/**
+ * Everything one assembly run needs: the assembler, the operand list the parser fills and
+ * whether .end was seen. Parser and scanner are reentrant and reach it only through the
+ * parser context, so any number of files can be assembled at the same time.
+ * Opaque to the (C) parser.
+ */
+typedef struct AssemblerContextStruct AssemblerContext;
+
+/**
+ * Where the messages of one file go when several files are assembled at once, NULL
+ * prints them right away.
+ */
+typedef struct AssemblerLogStruct AssemblerLog;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+AssemblerContext* create_assembler_context(char* outputFile, AssemblerLog* log);
+void destroy_assembler_context(AssemblerContext* context);
+void print_message(AssemblerContext* context, const char* message); // parser messages go with the file's
+
+// operands of list directives (.global, .extern, .word, .equ) are pushed before, pass NULL for them
+void proc_instruction(AssemblerContext* context, enum Instruction name, const Token* arg1, const Token* arg2, const Token* arg3);
+void proc_operand_instruction(AssemblerContext* context, enum Instruction name, Operand operand, const Token* gpr1, const Token* gpr2);
+void push_back_list(AssemblerContext* context, Token arg);
+void clear_list(AssemblerContext* context);
+int check_end(AssemblerContext* context);
+int check_failed(AssemblerContext* context); // an assembler error ended the file
+
+// NULL for the parts the kind doesn't have
+Operand make_operand(AssemblerContext* context, enum OperandKind kind, const Token* reg, const Token* literal, const Token* symbol);
+
+// the whole file mapped in memory and followed by two null bytes, as the scanner wants it; NULL on error
+char* map_source_file(const char* name, size_t* size, AssemblerLog* log);
+void unmap_source_file(char* source, size_t size);
+
+// parses one file with its own scanner and context (parser.y), 0 on success
+int assemble_file(char* inputFile, char* outputFile, AssemblerLog* log);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#define CAUSE_BAD_INSTRUCTION 1
+#define CAUSE_TIMER 2
+#define CAUSE_TERMINAL 3
+#define CAUSE_SOFTWARE 4
+#define CAUSE_BLOCK 5
+
+#define TIMER_BIT 0 // Tr (Timer) - maskiranje prekida od tajmera (0 - omogućen, 1 - maskiran)
+#define TERMINAL_BIT 1 // Tl (Terminal) - maskiranje prekida od terminala (0 - omogućen, 1 - maskiran) 
+#define INTERRUPT_BIT 2 // I (Interrupt) - globalno maskiranje spoljašnjih prekida (0 - omogućeni, 1 - maskirani)
+#define BLOCK_BIT 3 // Bl (Block) - maskiranje prekida od blok uredjaja (0 - omogućen, 1 - maskiran)
+
+#define NUMBER_OF_CAUSES 32 // one pending bit per cause
+
+#define HISTOGRAM_SUB_BUCKETS 16 // buckets per power of two, values are kept within 1/16
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Fixed size log-linear histogram: values below HISTOGRAM_SUB_BUCKETS are counted exactly,
+ * larger ones in HISTOGRAM_SUB_BUCKETS buckets per power of two. Percentiles are reported as
+ * the upper end of their bucket, the maximum exactly.
+ */
+class LatencyHistogram{
+private:
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    uint64_t max;
+
+    static uint32_t bucket_of(uint64_t value);
+    static uint64_t bucket_end(uint32_t bucket);
+
+public:
+    LatencyHistogram(): buckets(HISTOGRAM_BUCKETS), count(0), max(0) {}
+
+    void record(uint64_t value);
+    uint64_t percentile(double fraction);
+
+    uint64_t get_count(){ return count; }
+    uint64_t get_max(){ return max; }
+};
+
+/**
+ * Interrupt controller.
+ * 
+ * Devices raise external interrupts from any thread by setting a bit in the pending word
+ * (bit index = cause). The CPU only looks at the pending word at basic block ends, and only 
+ * when it is non-zero does it pay for masking and priority selection.
+ */
+class InterruptController{
+private:
+
+    struct PriorityEntryStruct{
+        uint32_t cause;
+        uint32_t maskBit;
+    };
+    typedef PriorityEntryStruct PriorityEntry;
+
+    // fixed priorities, highest first.
+    static const PriorityEntry priorities[];
+    static const int numberOfPriorities;
+
+    std::atomic<uint32_t> pending;
+    std::atomic<uint64_t> raiseTime[NUMBER_OF_CAUSES]; // steady clock nanoseconds of the raise that set the pending bit
+
+public:
+    InterruptController(){
+        pending.store(0);
+        for(int i = 0; i < NUMBER_OF_CAUSES; i ++){
+            raiseTime[i].store(0);
+        }
+    }
+
+    void raise(uint32_t cause);
+    void clear(uint32_t cause);
+
+    void reset(){
+        pending.store(0);
+    }
+
+    bool has_pending(){
+        return pending.load(std::memory_order_relaxed) != 0;
+    }
+
+    uint32_t get_pending(){
+        return pending.load(std::memory_order_acquire);
+    }
+
+    uint64_t get_raise_time(uint32_t cause){
+        return raiseTime[cause].load(std::memory_order_relaxed);
+    }
+
+    static uint64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t acknowledge(uint32_t status);
+};
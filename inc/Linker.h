@@ -31,6 +31,7 @@ private:
     // undefined symbol index -> NDX; 
     static const int UND = -1;
     static const int EXT = -2;
+    static const int ABS = -3; // absolute symbol (.equ constant), its value is not relocated
   
     struct SymbolTableRowStruct
     {
@@ -92,6 +93,8 @@ private:
 
     bool relocatableOption;
 
+    string mapFile;
+
     //------------------------------------------
     vector<SymbolTableRow*> symbolTableGeneral;
 
@@ -119,6 +122,8 @@ public:
 
     void startLinking();
 
+    void set_map_file(string name){ this->mapFile = name; }
+
 private:
     void generate_file_structures();
     void generate_new_tables();
@@ -157,6 +162,7 @@ private:
 
     void generate_linkable_elf();
     void generate_executable_elf();
+    void generate_symbol_map();
 };
 
 
@@ -191,6 +197,7 @@ int main(int argc, char *argv[]){
     cout << "LINKER STARTING..." << endl << endl;
 
     std::string outputFile;
+    std::string mapFile;
     bool hexFlag = false, relocatableFlag = false;
 
     // To store section placement information
@@ -220,6 +227,9 @@ int main(int argc, char *argv[]){
                 sp.address = placeArg.substr(atPos + 1);
                 sectionPlacements.push_back(sp);
             }
+        } else if (arg.rfind("-map=", 0) == 0) {
+            // Handle the -map=<naziv_datoteke> option (symbol map of the executable)
+            mapFile = arg.substr(5);
         } else if (arg == "-hex") {
             // Handle the -hex option
             hexFlag = true;
@@ -278,6 +288,10 @@ int main(int argc, char *argv[]){
 
     Linker linker(inputFiles, places, outputFile, hexFlag, relocatableFlag);
 
+    if (!mapFile.empty()) {
+        linker.set_map_file(mapFile);
+    }
+
     linker.startLinking();
     
     return 0;
@@ -0,0 +1,60 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Bounded lock-free queue for exactly one producer thread and one consumer thread.
+ * Size must be a power of two. Head and tail are free running counters, each written by
+ * one side only, and kept on separate cache lines.
+ */
+template <typename T, size_t Size>
+class SpscQueue{
+private:
+    static_assert((Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+    T items[Size];
+    alignas(64) std::atomic<uint64_t> head; // written by the producer
+    alignas(64) std::atomic<uint64_t> tail; // written by the consumer
+
+public:
+    SpscQueue(){
+        head.store(0);
+        tail.store(0);
+    }
+
+    // producer
+    bool push(const T& item){
+        uint64_t position = head.load(std::memory_order_relaxed);
+        if(position - tail.load(std::memory_order_acquire) == Size){
+            return false;
+        }
+        items[position % Size] = item;
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t free_space(){
+        return Size - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+    }
+
+    // consumer
+    bool pop(T& item){
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        if(position == head.load(std::memory_order_acquire)){
+            return false;
+        }
+        item = items[position % Size];
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty(){
+        return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+    }
+
+    // only while neither side is running
+    void clear(){
+        head.store(0);
+        tail.store(0);
+    }
+};
@@ -0,0 +1,83 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <cstdint>
+
+#include "TraceRecorder.h"
+
+/**
+ * Reads a trace written by the emulator (--trace=<file>), reconstructs pc, instruction word,
+ * memory addresses and interrupts of every record and prints a summary, or every record with -dump.
+ */
+class TraceReader{
+private:
+    std::string inputFileName;
+    bool dump;
+
+    std::vector<unsigned char> data;
+    size_t position;
+
+    // reconstruction state, mirrors the recorder
+    uint32_t pc;
+    bool started; // the first delta only moves pc from 0 to the entry point
+    bool interruptEntered; // the next delta goes to the handler, not a jump
+    uint32_t address;
+    std::unordered_map<uint32_t, uint32_t> words;
+
+    // summary
+    uint64_t instructions;
+    uint64_t jumps; // pc did not advance by 4 (not counting the start and interrupt entries)
+    uint64_t reads;
+    uint64_t writes;
+    std::unordered_map<uint32_t, uint64_t> pcCounts;
+    std::unordered_set<uint32_t> addresses;
+    std::map<uint32_t, uint64_t> interrupts;
+
+public:
+    TraceReader(std::string inputFileName, bool dump):
+        inputFileName(inputFileName), dump(dump), position(0), pc(0), started(false), interruptEntered(false), address(0),
+        instructions(0), jumps(0), reads(0), writes(0) {}
+
+    void read();
+
+private:
+    uint32_t get_varint();
+    int32_t get_signed();
+
+    void print_summary();
+    void error_print_and_exit(std::string errorMessage);
+};
+
+int main(int argc, char* argv[]) {
+    std::string inputFile;
+    bool dump = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "-dump") {
+            dump = true;
+        } else if (arg[0] != '-' && inputFile.empty()) {
+            inputFile = arg;
+        } else {
+            std::cerr << "TraceReader: ERROR -> unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (inputFile.empty()) {
+        std::cerr << "TraceReader: ERROR -> Usage: " << argv[0] << " [-dump] <trace file>\n";
+        return 1;
+    }
+
+    TraceReader reader(inputFile, dump);
+    reader.read();
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * Trace file format (read by the trace reader, see TraceReader.h):
+ *
+ *   "EMUTRACE" version(1 byte) records...
+ *
+ * Every record starts with a header byte, the record type is in its low 2 bits.
+ * Numbers are LEB128 varints, signed ones zigzag encoded.
+ */
+#define TRACE_MAGIC "EMUTRACE"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 1
+
+#define TRACE_TYPE_MASK 0x3
+#define TRACE_INSTRUCTION 0 // [pc delta] [word]: pc = previous pc + 4 unless TRACE_PC_DELTA
+#define TRACE_READ 1 // address delta from the previous memory address
+#define TRACE_WRITE 2 // address delta from the previous memory address
+#define TRACE_INTERRUPT 3 // cause
+
+#define TRACE_PC_DELTA 0x4 // signed pc delta follows
+#define TRACE_NEW_WORD 0x8 // first time this word is seen at this pc, the word follows
+
+#define TRACE_BUFFER_SIZE (1 << 22) // ring buffer between the cpu and the writer thread
+#define TRACE_CHUNK_SIZE 4096 // records are encoded locally and handed over a chunk at a time
+
+/**
+ * Instruction trace recorder.
+ *
+ * The cpu thread encodes records into a local chunk and moves full chunks into a single
+ * producer, single consumer ring buffer. A background thread writes the ring buffer to the
+ * file. Nothing is dropped: a full ring buffer makes the cpu wait for the writer.
+ */
+class TraceRecorder{
+private:
+    FILE* file;
+
+    std::vector<unsigned char> ring;
+    std::atomic<uint64_t> head; // written by the cpu thread
+    std::atomic<uint64_t> tail; // written by the writer thread
+
+    std::thread writer;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::atomic<bool> stopFlag;
+    bool stopped;
+
+    unsigned char chunk[TRACE_CHUNK_SIZE];
+    uint32_t chunkSize;
+
+    uint32_t previousPc;
+    uint32_t previousAddress;
+    std::unordered_map<uint32_t, uint32_t> seenWords;
+
+    uint64_t instructions;
+    uint64_t bytes;
+
+public:
+    TraceRecorder(std::string fileName);
+    ~TraceRecorder();
+
+    bool is_open(){ return file != nullptr; }
+
+    void instruction(uint32_t pc, uint32_t word);
+    void memory_read(uint32_t address){ memory_access(TRACE_READ, address); }
+    void memory_write(uint32_t address){ memory_access(TRACE_WRITE, address); }
+    void interrupt(uint32_t cause);
+
+    void stop();
+
+    uint64_t get_instructions(){ return instructions; }
+    uint64_t get_bytes(){ return bytes; }
+
+private:
+    void memory_access(uint32_t type, uint32_t address);
+
+    void put_byte(unsigned char byte){
+        if(chunkSize == TRACE_CHUNK_SIZE){
+            flush_chunk();
+        }
+        chunk[chunkSize++] = byte;
+    }
+    void put_varint(uint32_t value);
+    void put_signed(int32_t value){ put_varint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31)); }
+
+    void flush_chunk();
+    void writer_thread_function();
+};
@@ -0,0 +1,114 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <cstdint>
+
+#define EXECUTE_START_ADDRESS 0x40000000
+#define WORD_SIZE 4
+
+#define PC_INDEX 15
+#define SP_INDEX 14
+
+/**
+ * Ahead-of-time translator: turns the linked hex image into C++ source that is compiled
+ * together with the emulator (make program_native_).
+ *
+ * Code is discovered statically from the entry points: the start address, -entry= addresses,
+ * static jump and call targets, targets loaded from literal pools and image addresses loaded
+ * into registers (interrupt handlers, function pointers). Every discovered block becomes a
+ * label in one function; blocks jump to each other directly when the target is known and go
+ * through a switch on pc otherwise. Whatever was not discovered, and instructions the
+ * translator does not handle (halt, bad instructions), are left to the interpreter.
+ */
+class Translator{
+private:
+    struct InstructionStruct{
+        uint32_t address;
+        uint32_t fullInstruction;
+        uint32_t oc;
+        uint32_t mod;
+        uint32_t regA;
+        uint32_t regB;
+        uint32_t regC;
+        uint32_t disp;
+    };
+    typedef InstructionStruct Instruction;
+
+    std::string inputFileName;
+    std::string outputFileName;
+    std::vector<uint32_t> entries;
+
+    std::map<uint32_t, unsigned char> memory;
+
+    // discovered instructions, in address order
+    std::map<uint32_t, Instruction> instructions;
+    // predicted targets of the instruction at the address
+    std::map<uint32_t, std::vector<uint32_t>> targets;
+    // addresses execution can arrive at from somewhere else than the previous instruction
+    std::set<uint32_t> leaders;
+
+public:
+    Translator(std::string inputFileName, std::string outputFileName, std::vector<uint32_t> entries):
+        inputFileName(inputFileName), outputFileName(outputFileName), entries(entries) {}
+
+    void translate();
+
+private:
+    void load_image();
+    bool image_word(uint32_t address, uint32_t& word);
+    Instruction decode(uint32_t address, uint32_t word);
+
+    void discover();
+    bool is_translatable(Instruction instruction);
+    bool may_write_pc(Instruction instruction);
+    bool always_writes_pc(Instruction instruction);
+
+    void generate();
+    std::string generate_instruction(Instruction instruction);
+    std::string label(uint32_t address);
+
+    void error_print_and_exit(std::string errorMessage);
+};
+
+int main(int argc, char* argv[]) {
+    std::string inputFile;
+    std::string outputFile;
+    std::vector<uint32_t> entries;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "-o" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (arg.rfind("-entry=", 0) == 0) {
+            // additional entry point, e.g. a handler installed by computing its address
+            try {
+                entries.push_back(std::stoul(arg.substr(7), nullptr, 0));
+            } catch (...) {
+                std::cerr << "Translator: ERROR -> bad entry address " << arg.substr(7) << "\n";
+                return 1;
+            }
+        } else if (arg[0] != '-' && inputFile.empty()) {
+            inputFile = arg;
+        } else {
+            std::cerr << "Translator: ERROR -> unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    if (inputFile.empty() || outputFile.empty()) {
+        std::cerr << "Translator: ERROR -> Usage: " << argv[0] << " -o <output.cpp> [-entry=<address>] <program.hex>\n";
+        return 1;
+    }
+
+    Translator translator(inputFile, outputFile, entries);
+    translator.translate();
+
+    return 0;
+}
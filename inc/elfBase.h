@@ -92,6 +92,8 @@ typedef Elf32_ShdrStruct Elf32_Shdr;
 #define ELF32_ST_TYPE(val) ((val) & 0xf) // getter
 #define STT_NOTYPE 0
 #define STT_SECTION 1
+
+#define SHN_ABS 0xFFF1 // st_shndx of an absolute symbol: its value is never relocated
 struct Elf32_SymStruct{
     Elf32_Word st_name;
     Elf32_Byte st_info; // bind
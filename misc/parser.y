@@ -1,23 +1,20 @@
 // /* If we want to use other functions, we have to put the relevant
 //  * header includes here. */
+%code requires {
+  #include "./inc/Helper.h"
+}
+
 %{
-  int yylex(void);
-  void yyerror(const char *s);
-  
   #include <stdio.h>
   #include <string.h>
   #include <stdlib.h>
-  #include "./inc/Helper.h"
-
-  extern void proc_instruction(int name, ...);
-  extern void push_back_list(char* arg);
-  extern void clear_list();
-
-  extern int check_end();
-
-  extern void set_output_file(char* name);
 %}
 
+/* Reentrant parser: the scanner and the assembler context are passed in, nothing is global. */
+%define api.pure full
+%lex-param {void* scanner}
+%parse-param {void* scanner} {AssemblerContext* context}
+
 /* These declare our output file names. */
 %output "parser.c"
 %defines "parser.h"
@@ -25,69 +22,88 @@
 /* This union defines the possible return types of both lexer and
  * parser rules. We'll refer to these later on by the field name */
 %union {
-  char* str;
-  char* operand;
+  Token token;
+  Operand operand;
 }
 
-%token <str> TOKEN_GLOBAL
-%token <str> TOKEN_EXTERN
-%token <str> TOKEN_SECTION
-%token <str> TOKEN_WORD
-%token <str> TOKEN_SKIP
-%token <str> TOKEN_ASCII
-%token <str> TOKEN_EQU
-%token <str> TOKEN_END
+%token <token> TOKEN_GLOBAL
+%token <token> TOKEN_EXTERN
+%token <token> TOKEN_SECTION
+%token <token> TOKEN_WORD
+%token <token> TOKEN_SKIP
+%token <token> TOKEN_ASCII
+%token <token> TOKEN_EQU
+%token <token> TOKEN_LTORG
+%token <token> TOKEN_END
 
 // instructions 
-%token <str> TOKEN_HALT
-%token <str> TOKEN_INT
-%token <str> TOKEN_IRET
-%token <str> TOKEN_CALL
-%token <str> TOKEN_RET
-%token <str> TOKEN_JMP
-%token <str> TOKEN_BEQ
-%token <str> TOKEN_BNE
-%token <str> TOKEN_BGT
-%token <str> TOKEN_PUSH
-%token <str> TOKEN_POP
-%token <str> TOKEN_XCHG
-%token <str> TOKEN_ADD
-%token <str> TOKEN_SUB
-%token <str> TOKEN_MUL
-%token <str> TOKEN_DIV
-%token <str> TOKEN_NOT
-%token <str> TOKEN_AND
-%token <str> TOKEN_OR
-%token <str> TOKEN_XOR
-%token <str> TOKEN_SHL
-%token <str> TOKEN_SHR
-%token <str> TOKEN_LD
-%token <str> TOKEN_ST
-%token <str> TOKEN_CSRRD
-%token <str> TOKEN_CSRWR
+%token <token> TOKEN_HALT
+%token <token> TOKEN_INT
+%token <token> TOKEN_IRET
+%token <token> TOKEN_CALL
+%token <token> TOKEN_RET
+%token <token> TOKEN_JMP
+%token <token> TOKEN_BEQ
+%token <token> TOKEN_BNE
+%token <token> TOKEN_BGT
+%token <token> TOKEN_PUSH
+%token <token> TOKEN_POP
+%token <token> TOKEN_XCHG
+%token <token> TOKEN_ADD
+%token <token> TOKEN_SUB
+%token <token> TOKEN_MUL
+%token <token> TOKEN_DIV
+%token <token> TOKEN_NOT
+%token <token> TOKEN_AND
+%token <token> TOKEN_OR
+%token <token> TOKEN_XOR
+%token <token> TOKEN_SHL
+%token <token> TOKEN_SHR
+%token <token> TOKEN_LD
+%token <token> TOKEN_ST
+%token <token> TOKEN_CSRRD
+%token <token> TOKEN_CSRWR
 
 // gprX
-%token <str> TOKEN_GPRX
+%token <token> TOKEN_GPRX
 
 // csrX
-%token <str> TOKEN_CSRX
+%token <token> TOKEN_CSRX
 
 // chars
-%token <str> TOKEN_PLUS
-%token <str> TOKEN_COMMA
-%token <str> TOKEN_DOLLAR
-%token <str> TOKEN_LEFT_BRACKET
-%token <str> TOKEN_RIGHT_BRACKET
+%token <token> TOKEN_PLUS
+%token <token> TOKEN_MINUS
+%token <token> TOKEN_STAR
+%token <token> TOKEN_SLASH
+%token <token> TOKEN_SHIFT_LEFT
+%token <token> TOKEN_SHIFT_RIGHT
+%token <token> TOKEN_LEFT_PAREN
+%token <token> TOKEN_RIGHT_PAREN
+%token <token> TOKEN_COMMA
+%token <token> TOKEN_DOLLAR
+%token <token> TOKEN_LEFT_BRACKET
+%token <token> TOKEN_RIGHT_BRACKET
 
 // primitive types
-%token <str> TOKEN_LITERAL
-%token <str> TOKEN_SYMBOL
-%token <str> TOKEN_STRING
-%token <str> TOKEN_LABEL
+%token <token> TOKEN_LITERAL
+%token <token> TOKEN_SYMBOL
+%token <token> TOKEN_STRING
+%token <token> TOKEN_LABEL
 
 // dynamics
 %type <operand> operand
 
+// .equ expression operators, lowest precedence first
+%left TOKEN_SHIFT_LEFT TOKEN_SHIFT_RIGHT
+%left TOKEN_PLUS TOKEN_MINUS
+%left TOKEN_STAR TOKEN_SLASH
+%right UNARY_MINUS
+
+%code {
+  int yylex(YYSTYPE* yylval, void* scanner);
+  void yyerror(void* scanner, AssemblerContext* context, const char* msg);
+}
+
 %start prog
 
 %%
@@ -100,114 +116,131 @@ prog
     ;
 
 directive
-  : TOKEN_GLOBAL  lista_simbola              { proc_instruction(GLOBAL, NULL); }
-  | TOKEN_EXTERN  lista_simbola              { proc_instruction(EXTERN, NULL); }
-  | TOKEN_SECTION TOKEN_SYMBOL               { proc_instruction(SECTION, $2, NULL); }
-  | TOKEN_WORD    lista_simbola_ili_literala { proc_instruction(WORD, NULL); }
-  | TOKEN_SKIP    TOKEN_LITERAL              { proc_instruction(SKIP, $2, NULL); }
-  | TOKEN_ASCII   TOKEN_STRING               { proc_instruction(ASCII, $2, NULL); }
-  | TOKEN_END                                { proc_instruction(END, NULL); }
+  : TOKEN_GLOBAL  lista_simbola              { proc_instruction(context, GLOBAL, NULL, NULL, NULL); }
+  | TOKEN_EXTERN  lista_simbola              { proc_instruction(context, EXTERN, NULL, NULL, NULL); }
+  | TOKEN_SECTION TOKEN_SYMBOL               { proc_instruction(context, SECTION, &$2, NULL, NULL); }
+  | TOKEN_WORD    lista_simbola_ili_literala { proc_instruction(context, WORD, NULL, NULL, NULL); }
+  | TOKEN_SKIP    TOKEN_LITERAL              { proc_instruction(context, SKIP, &$2, NULL, NULL); }
+  | TOKEN_ASCII   TOKEN_STRING               { proc_instruction(context, ASCII, &$2, NULL, NULL); }
+  | TOKEN_LTORG                              { proc_instruction(context, LTORG, NULL, NULL, NULL); }
+  | TOKEN_EQU     TOKEN_SYMBOL TOKEN_COMMA   { clear_list(context); push_back_list(context, $2); }
+                  expression                 { proc_instruction(context, EQU, NULL, NULL, NULL); }
+  | TOKEN_END                                { proc_instruction(context, END, NULL, NULL, NULL); }
   ;
 
 instr
-  : TOKEN_HALT                                                        { proc_instruction(HALT, NULL); }
-  | TOKEN_INT                                                         { proc_instruction(INT, NULL); }
-  | TOKEN_IRET                                                        { proc_instruction(IRET, NULL); }
-  | TOKEN_CALL  operand                                               { proc_instruction(CALL, $2, NULL); }
-  | TOKEN_RET                                                         { proc_instruction(RET, NULL); }
-  | TOKEN_JMP   operand                                               { proc_instruction(JMP, $2, NULL); }
-  | TOKEN_BEQ   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX TOKEN_COMMA operand { proc_instruction(BEQ, $2, $4, $6, NULL); }
-  | TOKEN_BNE   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX TOKEN_COMMA operand { proc_instruction(BNE, $2, $4, $6, NULL); }
-  | TOKEN_BGT   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX TOKEN_COMMA operand { proc_instruction(BGT, $2, $4, $6, NULL); }
-  | TOKEN_PUSH  TOKEN_GPRX                                            { proc_instruction(PUSH, $2, NULL); }
-  | TOKEN_POP   TOKEN_GPRX                                            { proc_instruction(POP, $2, NULL); }
-  | TOKEN_XCHG  TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(XCHG, $2, $4, NULL); }
-  | TOKEN_ADD   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(ADD, $2, $4, NULL); }
-  | TOKEN_SUB   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(SUB, $2, $4, NULL); }
-  | TOKEN_MUL   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(MUL, $2, $4, NULL); }
-  | TOKEN_DIV   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(DIV, $2, $4, NULL); }
-  | TOKEN_NOT   TOKEN_GPRX                                            { proc_instruction(NOT, $2, NULL); }
-  | TOKEN_AND   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(AND, $2, $4, NULL); }
-  | TOKEN_OR    TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(OR, $2, $4, NULL); }
-  | TOKEN_XOR   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(XOR, $2, $4, NULL); }
-  | TOKEN_SHL   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(SHL, $2, $4, NULL); }
-  | TOKEN_SHR   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(SHR, $2, $4, NULL); }
-  | TOKEN_LD    operand    TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(LD, $2, $4, NULL); }
-  | TOKEN_ST    TOKEN_GPRX TOKEN_COMMA operand                        { proc_instruction(ST, $2, $4, NULL); }
-  | TOKEN_CSRRD TOKEN_CSRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(CSRRD, $2, $4, NULL); }
-  | TOKEN_CSRWR TOKEN_GPRX TOKEN_COMMA TOKEN_CSRX                     { proc_instruction(CSRWR, $2, $4, NULL); }
+  : TOKEN_HALT                                                        { proc_instruction(context, HALT, NULL, NULL, NULL); }
+  | TOKEN_INT                                                         { proc_instruction(context, INT, NULL, NULL, NULL); }
+  | TOKEN_IRET                                                        { proc_instruction(context, IRET, NULL, NULL, NULL); }
+  | TOKEN_CALL  operand                                               { proc_operand_instruction(context, CALL, $2, NULL, NULL); }
+  | TOKEN_RET                                                         { proc_instruction(context, RET, NULL, NULL, NULL); }
+  | TOKEN_JMP   operand                                               { proc_operand_instruction(context, JMP, $2, NULL, NULL); }
+  | TOKEN_BEQ   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX TOKEN_COMMA operand { proc_operand_instruction(context, BEQ, $6, &$2, &$4); }
+  | TOKEN_BNE   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX TOKEN_COMMA operand { proc_operand_instruction(context, BNE, $6, &$2, &$4); }
+  | TOKEN_BGT   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX TOKEN_COMMA operand { proc_operand_instruction(context, BGT, $6, &$2, &$4); }
+  | TOKEN_PUSH  TOKEN_GPRX                                            { proc_instruction(context, PUSH, &$2, NULL, NULL); }
+  | TOKEN_POP   TOKEN_GPRX                                            { proc_instruction(context, POP, &$2, NULL, NULL); }
+  | TOKEN_XCHG  TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, XCHG, &$2, &$4, NULL); }
+  | TOKEN_ADD   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, ADD, &$2, &$4, NULL); }
+  | TOKEN_SUB   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, SUB, &$2, &$4, NULL); }
+  | TOKEN_MUL   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, MUL, &$2, &$4, NULL); }
+  | TOKEN_DIV   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, DIV, &$2, &$4, NULL); }
+  | TOKEN_NOT   TOKEN_GPRX                                            { proc_instruction(context, NOT, &$2, NULL, NULL); }
+  | TOKEN_AND   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, AND, &$2, &$4, NULL); }
+  | TOKEN_OR    TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, OR, &$2, &$4, NULL); }
+  | TOKEN_XOR   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, XOR, &$2, &$4, NULL); }
+  | TOKEN_SHL   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, SHL, &$2, &$4, NULL); }
+  | TOKEN_SHR   TOKEN_GPRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, SHR, &$2, &$4, NULL); }
+  | TOKEN_LD    operand    TOKEN_COMMA TOKEN_GPRX                     { proc_operand_instruction(context, LD, $2, &$4, NULL); }
+  | TOKEN_ST    TOKEN_GPRX TOKEN_COMMA operand                        { proc_operand_instruction(context, ST, $4, &$2, NULL); }
+  | TOKEN_CSRRD TOKEN_CSRX TOKEN_COMMA TOKEN_GPRX                     { proc_instruction(context, CSRRD, &$2, &$4, NULL); }
+  | TOKEN_CSRWR TOKEN_GPRX TOKEN_COMMA TOKEN_CSRX                     { proc_instruction(context, CSRWR, &$2, &$4, NULL); }
   ;
 
 label
-  : TOKEN_LABEL { proc_instruction(LABEL, $1, NULL); }
+  : TOKEN_LABEL { proc_instruction(context, LABEL, &$1, NULL, NULL); }
   ;
 
 operand
-  : TOKEN_DOLLAR TOKEN_LITERAL { $$ = strcat(strcat($1, $2), "1"); }
-  | TOKEN_DOLLAR TOKEN_SYMBOL  { $$ = strcat(strcat($1, $2), "2"); }
-  | TOKEN_LITERAL  { $$ = strcat($1, "3"); }
-  | TOKEN_SYMBOL { $$ = strcat($1, "4"); }
-  | TOKEN_GPRX   { $$ = strcat($1, "5"); }
-  | TOKEN_LEFT_BRACKET TOKEN_GPRX TOKEN_RIGHT_BRACKET { $$ = strcat(strcat( strcat($1, $2), $3), "6"); }
-  | TOKEN_LEFT_BRACKET TOKEN_GPRX TOKEN_PLUS TOKEN_LITERAL TOKEN_RIGHT_BRACKET { 
-    $$ = strcat(strcat( strcat($1, $2), strcat( strcat($3, $4), $5 ) ), "7" ); 
-    }
-  | TOKEN_LEFT_BRACKET TOKEN_GPRX TOKEN_PLUS TOKEN_SYMBOL TOKEN_RIGHT_BRACKET { 
-      $$ = strcat(strcat( strcat($1, $2), strcat( strcat($3, $4), $5 ) ), "8" ); 
+  : TOKEN_DOLLAR TOKEN_LITERAL { $$ = make_operand(context, OPERAND_IMMEDIATE_LITERAL, NULL, &$2, NULL); }
+  | TOKEN_DOLLAR TOKEN_SYMBOL  { $$ = make_operand(context, OPERAND_IMMEDIATE_SYMBOL, NULL, NULL, &$2); }
+  | TOKEN_LITERAL              { $$ = make_operand(context, OPERAND_MEMORY_LITERAL, NULL, &$1, NULL); }
+  | TOKEN_SYMBOL               { $$ = make_operand(context, OPERAND_MEMORY_SYMBOL, NULL, NULL, &$1); }
+  | TOKEN_GPRX                 { $$ = make_operand(context, OPERAND_REGISTER, &$1, NULL, NULL); }
+  | TOKEN_LEFT_BRACKET TOKEN_GPRX TOKEN_RIGHT_BRACKET {
+      $$ = make_operand(context, OPERAND_REGISTER_INDIRECT, &$2, NULL, NULL);
+  }
+  | TOKEN_LEFT_BRACKET TOKEN_GPRX TOKEN_PLUS TOKEN_LITERAL TOKEN_RIGHT_BRACKET {
+      $$ = make_operand(context, OPERAND_REGISTER_LITERAL, &$2, &$4, NULL);
+  }
+  | TOKEN_LEFT_BRACKET TOKEN_GPRX TOKEN_PLUS TOKEN_SYMBOL TOKEN_RIGHT_BRACKET {
+      $$ = make_operand(context, OPERAND_REGISTER_SYMBOL, &$2, NULL, &$4);
   }
   ;
 
+// pushed to the list in postfix order
+expression
+  : expression TOKEN_PLUS expression          { push_back_list(context, $2); }
+  | expression TOKEN_MINUS expression         { push_back_list(context, $2); }
+  | expression TOKEN_STAR expression          { push_back_list(context, $2); }
+  | expression TOKEN_SLASH expression         { push_back_list(context, $2); }
+  | expression TOKEN_SHIFT_LEFT expression    { push_back_list(context, $2); }
+  | expression TOKEN_SHIFT_RIGHT expression   { push_back_list(context, $2); }
+  | TOKEN_MINUS expression %prec UNARY_MINUS  { Token unaryMinus = { "u-", 2 }; push_back_list(context, unaryMinus); }
+  | TOKEN_LEFT_PAREN expression TOKEN_RIGHT_PAREN
+  | TOKEN_LITERAL                             { push_back_list(context, $1); }
+  | TOKEN_SYMBOL                              { push_back_list(context, $1); }
+  ;
+
 lista_simbola
-  : lista_simbola TOKEN_COMMA TOKEN_SYMBOL { push_back_list($3); }
-  | TOKEN_SYMBOL { clear_list(); push_back_list($1); }
+  : lista_simbola TOKEN_COMMA TOKEN_SYMBOL { push_back_list(context, $3); }
+  | TOKEN_SYMBOL { clear_list(context); push_back_list(context, $1); }
   ;
 
 lista_simbola_ili_literala
-  : lista_simbola_ili_literala TOKEN_COMMA TOKEN_SYMBOL { push_back_list($3); }
-  | lista_simbola_ili_literala TOKEN_COMMA TOKEN_LITERAL { push_back_list($3); }
-  | TOKEN_SYMBOL { clear_list(); push_back_list($1); }
-  | TOKEN_LITERAL { clear_list(); push_back_list($1); }
+  : lista_simbola_ili_literala TOKEN_COMMA TOKEN_SYMBOL { push_back_list(context, $3); }
+  | lista_simbola_ili_literala TOKEN_COMMA TOKEN_LITERAL { push_back_list(context, $3); }
+  | TOKEN_SYMBOL { clear_list(context); push_back_list(context, $1); }
+  | TOKEN_LITERAL { clear_list(context); push_back_list(context, $1); }
   ;
 
 %%
 
-void yyerror(const char* msg) {
-    fprintf(stderr, "Error: %s\n", msg);
+void yyerror(void* scanner, AssemblerContext* context, const char* msg) {
+    char message[256];
+    snprintf(message, sizeof(message), "Error: %s", msg);
+    print_message(context, message);
 }
 
-extern FILE* yyin;
-int main(int argc, char* argv[]){
-  printf("ASSEMBLER STARTING...\n");
-
-  char *outputFile = NULL;
-  char *inputFile = NULL;
-
-  // Traverse command line arguments
-  for (int i = 1; i < argc; i++) {
-      // Check for the -o option and extract the output file
-      if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
-          outputFile = argv[i + 1];
-          i++;  // Skip next argument since it is the output file
-      } else {
-          // Remaining argument is the input file
-          inputFile = argv[i];
-      }
-  }
-  
-  yyin = fopen(inputFile , "r");
-  if (!yyin) {
-      perror("fopen");
+#include "lexer.h"
+
+/**
+ * Assembles one file. Returns 0 on success.
+ */
+int assemble_file(char* inputFile, char* outputFile, AssemblerLog* log){
+  size_t size;
+  char* source = map_source_file(inputFile, &size, log);
+  if (source == NULL) {
       return 1;
   }
 
-  set_output_file(outputFile);
+  AssemblerContext* context = create_assembler_context(outputFile, log);
+
+  // scanned in place, tokens point into the mapping
+  yyscan_t scanner;
+  yylex_init(&scanner);
+  yy_scan_buffer(source, size + 2, scanner);
+
+  int result = yyparse(scanner, context);
 
-  yyparse();
-  
-  if(check_end() == 0){
-    printf("ERROR: no .end directive at the end of code!\n");
+  if(check_failed(context) != 0){
+    result = 1;
+  } else if(check_end(context) == 0){
+    print_message(context, "ERROR: no .end directive at the end of code!");
   }
-  
-  fclose(yyin);
-  return 0;
-} 
\ No newline at end of file
+
+  yylex_destroy(scanner);
+  destroy_assembler_context(context);
+  unmap_source_file(source, size);
+  return result;
+}
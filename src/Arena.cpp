@@ -0,0 +1,39 @@
+#include "./../inc/Arena.h"
+
+Arena::~Arena()
+{
+    release();
+}
+
+/**
+ * Current block is full: a new one. Requests bigger than a block get a block of their own,
+ * and the current block stays in use for the small ones.
+ */
+void* Arena::allocate_block(size_t size, size_t alignment)
+{
+    size_t blockSize = size + alignment > ARENA_BLOCK_SIZE ? size + alignment : ARENA_BLOCK_SIZE;
+    char* block = new char[blockSize];
+    blocks.push_back(block);
+
+    char* result = block + (-reinterpret_cast<uintptr_t>(block) & (alignment - 1));
+    allocated += size;
+
+    if(blockSize == ARENA_BLOCK_SIZE){
+        cursor = result + size;
+        end = block + blockSize;
+    }
+
+    return result;
+}
+
+void Arena::release()
+{
+    for(char* block: blocks){
+        delete[] block;
+    }
+    blocks.clear();
+
+    cursor = nullptr;
+    end = nullptr;
+    allocated = 0;
+}
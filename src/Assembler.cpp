@@ -4,70 +4,62 @@ void Assembler::global(vector<string> params)
 {
 
     for(string param: params){
+        SymbolTableRow& symbol = symbolTable[intern_symbol(param)];
 
-        if(symbolTableMap.find(param) == symbolTableMap.end()){
-            SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, GLOB, UND, param, false);
-
-            symbolTable.push_back(s);
-            symbolTableMap[s->name] = s;
-            
-        } else {
-            if(symbolTableMap[param]->ndx == EXT){
-                std::cout << "Assembler: ERROR -> not allowed calling global after extern for the same symbol!" << endl;
-                exit(0);
-            }
-
-            symbolTableMap[param]->bind = GLOB;
+        if(symbol.ndx == EXT){
+            *messages << "Assembler: ERROR -> not allowed calling global after extern for the same symbol!" << endl;
+            throw AssemblerError();
         }
+
+        symbol.bind = GLOB;
     }
 }
 
 void Assembler::externI(vector<string> params)
 {
     for(string param: params){
-        
-        // symbol doesn't exist in the table
-        if(symbolTableMap.find(param) == symbolTableMap.end()){
-            SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, NOTYP, GLOB, EXT, param, false);
-
-            symbolTable.push_back(s);
-            symbolTableMap[s->name] = s;
-        } else {   // symbol already exists. Just update it.
-
-            // symbol already initialized with label
-            if(symbolTableMap[param]->type != WFI){
-                std::cout << "Assembler: ERROR -> Calling extern on already defined symbol " << symbolTableMap[param]->name << endl;
-                exit(0);
-            }
-           
-            if(symbolTableMap[param]->bind == GLOB){
-                std::cout << "Assembler: ERROR -> not allowed calling extern after global for the same symbol!" << endl;
-                exit(0);
-            }
+        int id = intern_symbol(param);
+        SymbolTableRow& symbol = symbolTable[id];
 
-            if(symbolTableMap[param]->equ == true){
-                std::cout << "Assembler: ERROR -> not allowed calling extern for symbols that have been initialized with equ!" << endl;
-                exit(0);
-            }
-            symbolTableMap[param]->bind = GLOB;
-            symbolTableMap[param]->type = NOTYP;
-            symbolTableMap[param]->ndx = EXT;
+        // symbol already initialized with label
+        if(symbol.type != WFI){
+            *messages << "Assembler: ERROR -> Calling extern on already defined symbol " << symbol.name << endl;
+            throw AssemblerError();
+        }
+       
+        if(symbol.bind == GLOB){
+            *messages << "Assembler: ERROR -> not allowed calling extern after global for the same symbol!" << endl;
+            throw AssemblerError();
         }
 
+        if(symbol.equ == true){
+            *messages << "Assembler: ERROR -> not allowed calling extern for symbols that have been initialized with equ!" << endl;
+            throw AssemblerError();
+        }
+        symbol.bind = GLOB;
+        symbol.type = NOTYP;
+        symbol.ndx = EXT;
+
+        symbol_defined(id);
     }
 }
 
 void Assembler::section(string sectionName)
 {
-    // error, symbol with the said name already exists in the map and is initialized.
-    if(symbolTableMap.find(sectionName) != symbolTableMap.end() && symbolTableMap[sectionName]->type != WFI){
-        std::cout << "Assembler: ERROR, symbol with the name " << sectionName << " already exists in the symbol table" << endl;
-        exit(0);
+    int id = intern_symbol(sectionName);
+
+    // error, symbol with the said name already exists in the table and is initialized.
+    if(symbolTable[id].type != WFI){
+        *messages << "Assembler: ERROR, symbol with the name " << sectionName << " already exists in the symbol table" << endl;
+        throw AssemblerError();
     }        
 
     sectionCounter++;
 
     if (currentSection != "0"){
+        // constants of the section that just ended go after its code.
+        place_literal_pool(false);
+
         // set length of section that just ended.
         sectionTable[currentSection]->length = locationCounter - sectionTable[currentSection]->base;
     }
@@ -78,26 +70,24 @@ void Assembler::section(string sectionName)
     currentSection = sectionName;
     sectionTable[currentSection] = new SectionDefinition();
     sectionTable[currentSection]->name = sectionName;
+    sectionTable[currentSection]->symbol = id;
     sectionTable[currentSection]->base = locationCounter;
 
-    // add new section in symbol table
-    if(symbolTableMap.find(sectionName) == symbolTableMap.end()){
-        SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, SCTN, LOC, sectionCounter, sectionName, false);
-        symbolTableMap[s->name] = s;
-        symbolTable.push_back(s);
-    }
-    else{
-        
-        symbolTableMap[sectionName]->type = SCTN;
-    }
+    // the section in symbol table
+    symbolTable[id].type = SCTN;
+    symbolTable[id].ndx = sectionCounter;
+    sectionSymbols.push_back(id);
+
+    // .equ symbols that used the section name before it was opened
+    symbol_defined(id);
 }
 
 void Assembler::word(vector<string> params)
 {
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> word attempted outside of a section." << endl;
-        exit(0);
+        *messages << "assembler: ERROR -> word attempted outside of a section." << endl;
+        throw AssemblerError();
     }
 
     for (string param: params){
@@ -113,19 +103,13 @@ void Assembler::word(vector<string> params)
 
         } else { // symbol
 
-            // symbol is not in the table ( add it )
-            if (symbolTableMap.find(param) == symbolTableMap.end()){ 
-                // add new symbol in symbol table
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, param, false);
+            int id = intern_symbol(param);
 
-                symbolTable.push_back(s);
-                symbolTableMap[s->name] = s;
-            }
             // Insert zeroes into machine code.
             insert_word_into_machine_code(0);
 
             // add to flink.
-            push_to_flink(param, -1, locationCounter, PLUS, false);
+            push_to_flink(id, -1, locationCounter, PLUS, false);
 
             // Increase location.
             locationCounter += WORD_SIZE;
@@ -137,14 +121,16 @@ void Assembler::skip(string param)
 {
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> skip attempted outside of a section." << endl;
-        exit(0);
+        *messages << "assembler: ERROR -> skip attempted outside of a section." << endl;
+        throw AssemblerError();
     }
 
     // Number of bytes to skip.
     
     int skipBytes = literal_to_int(param);
 
+    reserve_literal_pool_range(skipBytes);
+
     // Insert zeroes in machine code.
     sectionTable[currentSection]->data.insert(sectionTable[currentSection]->data.end(), skipBytes, 0);
 
@@ -157,10 +143,12 @@ void Assembler::ascii(string param)
 
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> ascii attempted outside of a section." << endl;
-        exit(0);
+        *messages << "assembler: ERROR -> ascii attempted outside of a section." << endl;
+        throw AssemblerError();
     }
 
+    reserve_literal_pool_range(param.size());
+
     // Set data in machine code.
     sectionTable[currentSection]->data.insert(sectionTable[currentSection]->data.end(), param.begin(), param.end());
    
@@ -168,19 +156,50 @@ void Assembler::ascii(string param)
     locationCounter += param.size();
 }
 
-void Assembler::equ()
+/**
+ * .equ name, expression. The expression comes in postfix order. It is resolved as soon as
+ * every symbol it uses is defined, which can be later in the file.
+ */
+void Assembler::equ(vector<string> params)
 {
-    std::cout << "Assembler: Warning -> equ not implemented yet" << endl;
+    int id = intern_symbol(params[0]);
+
+    if(symbolTable[id].type == WFI && symbolTable[id].equ == false){
+        symbolTable[id].equ = true;
+    } else {
+        *messages <<"Assembler: ERROR -> Re-initialization of symbol " << params[0] << endl;
+        throw AssemblerError();
+    }
+
+    equTable[id] = new EquDefinition(id, vector<string>(params.begin() + 1, params.end()));
+
+    resolve_equ(id);
 }
 
+/**
+ * Places the literal pool of the current section here. Nothing jumps over it, so it belongs
+ * after an unconditional jmp, ret, iret or halt.
+ */
+void Assembler::ltorg()
+{
+    // Error
+    if (currentSection == "0"){
+        *messages << "assembler: ERROR -> ltorg attempted outside of a section." << endl;
+        throw AssemblerError();
+    }
+
+    place_literal_pool(false);
+}
 
 void Assembler::end()
 {
 
     if(currentSection == "0"){
-        cout << "Assembler: ERROR -> No section was oppened" << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> No section was oppened" << endl;
+        throw AssemblerError();
     }
+    place_literal_pool(false);
+
         // set length of section that just ended.
     sectionTable[currentSection]->length = locationCounter - sectionTable[currentSection]->base;
     check_symbols_at_the_end();
@@ -199,8 +218,8 @@ void Assembler::halt()
 {
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> halt attempted outside of a section." << endl;
-        exit(0);
+        *messages << "assembler: ERROR -> halt attempted outside of a section." << endl;
+        throw AssemblerError();
     }
 
     insert_word_into_machine_code(0);
@@ -237,98 +256,22 @@ void Assembler::iret()
     locationCounter += 3 * WORD_SIZE;
 }
 
-void Assembler::call(string param)
+void Assembler::call(Operand target)
 {
     
     // Error Check
     if(currentSection == "0"){
-        std::cout << "Assembler: ERROR -> calling call outside of section!" << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> calling call outside of section!" << endl;
+        throw AssemblerError();
     }
 
-    char operandType = param[param.size() - 1];
+    // call -> push pc; pc<=gpr[A]+gpr[B]+D;
+    // call [pc + D] -> push pc; pc<=mem32[gpr[A]+gpr[B]+D];
+    // A = pc, D = distance to the target or to its address in the literal pool
+    int shortInsCode = 0x20F00000;
+    int insCode = 0x21F00000;
 
-    // Remove operand type character from the string;
-    param.erase(param.size() - 1, 1);
-
-    int insCode = -1;
-    int lit = -1;
-    size_t plusPosition = -1;
-
-    switch(operandType){
-        case '3': // literal
-            // call [pc + 4]
-            // JMP pc + 4
-            // 32 bit literal
-
-     
-            // call [pc + 4] -> push pc; pc<=mem32[gpr[A]+gpr[B]+D];
-            insCode = 0x21F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-    
-            // literal
-            
-            lit = literal_to_int(param);
-             // Insert into machine code;
-            insert_word_into_machine_code(lit);
-        
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-
-            break;
-        case '4': // symbol
-            // we translate this to
-            // call [pc + 4]
-            // JMP pc + 4
-            // 32 bit symbol value
-
-            // call [pc + 4] -> push pc; pc<=mem32[gpr[A]+gpr[B]+D];
-            insCode = 0x21F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-             // add to symbol table if needed:
-            if(symbolTableMap.find(param) == symbolTableMap.end()){
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, param, false);
-
-                symbolTable.push_back(s);
-                symbolTableMap[s->name] = s;
-                // add to flink.
-                push_to_flink(param, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                // Insert zeroes into machine code;
-                insert_word_into_machine_code(0);
-            }
-            else{
-                if(symbolTableMap[param]->type != WFI && symbolTableMap[param]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[param]->value);
-                }
-                else{
-                    // add to flink.
-                    push_to_flink(param, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                    // Insert zeroes into machine code;
-                    insert_word_into_machine_code(0);
-                }
-            }
-
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-            break;
-       
-        default:
-            std::cout << "Assembler: ERROR -> Unknown operand type for jump instructions: " << operandType << endl;
-            exit(0);
-    };
+    insert_branch_instruction(shortInsCode, insCode, branch_target(target));
 }
 
 // pop pc
@@ -343,382 +286,72 @@ void Assembler::ret()
 }
 
 // pc <= operand;
-void Assembler::jmp(string param)
+void Assembler::jmp(Operand target)
 {
      // Error Check
     if(currentSection == "0"){
-        std::cout << "Assembler: ERROR -> calling jmp outside of section!" << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> calling jmp outside of section!" << endl;
+        throw AssemblerError();
     }
 
-    char operandType = param[param.size() - 1];
-
-    // Remove operand type character from the string;
-    param.erase(param.size() - 1, 1);
-
-    int insCode = -1;
-    int lit = -1;
-    size_t plusPosition = -1;
-
-    
-    switch(operandType){
-        case '3': // literal
-            // jmp [pc]
-            // 32 bit literal
-
-     
-            // jmp [pc] -> push pc; pc<=mem32[gpr[A]+gpr[B]+D];
-            insCode = 0x38F00000;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-    
-            // literal
-            
-            lit = literal_to_int(param);
-             // Insert into machine code;
-            insert_word_into_machine_code(lit);
+    // jmp -> pc<=gpr[A]+D;
+    // jmp [pc + D] -> pc<=mem32[gpr[A]+D];
+    // A = pc, D = distance to the target or to its address in the literal pool
+    int shortInsCode = 0x30F00000;
+    int insCode = 0x38F00000;
 
-            // Increase location counter.
-            locationCounter += 2 * WORD_SIZE;
-
-            break;
-        case '4': // symbol
-            // we translate this to
-            // JMP [pc]
-            // 32 bit symbol value
-
-            // jmp [pc] -> push pc; pc<=mem32[gpr[A]+gpr[B]+D];
-            insCode = 0x38F00000;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-          
-
-            // add to symbol table if needed:
-            if(symbolTableMap.find(param) == symbolTableMap.end()){
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, param, false);
-
-                symbolTable.push_back(s);
-                symbolTableMap[s->name] = s;
-                // add to flink.
-                push_to_flink(param, -1, locationCounter + WORD_SIZE, PLUS, false);
-                // Insert zeroes into machine code;
-                insert_word_into_machine_code(0);
-            }
-            else{
-                if(symbolTableMap[param]->type != WFI && symbolTableMap[param]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[param]->value);
-                }
-                else{
-                    // add to flink.
-                    push_to_flink(param, -1, locationCounter + WORD_SIZE, PLUS, false);
-                    // Insert zeroes into machine code;
-                    insert_word_into_machine_code(0);
-                }
-            }
-
-            // Increase location counter.
-            locationCounter += 2 * WORD_SIZE;
-            break;
-       
-        default:
-            std::cout << "Assembler: ERROR -> Unknown operand type for jump instructions: " << operandType << endl;
-            exit(0);
-    };
+    insert_branch_instruction(shortInsCode, insCode, branch_target(target));
 }
 
-void Assembler::beq(vector<string> params)
+void Assembler::beq(int gpr1, int gpr2, Operand target)
 {
     // Error Check
     if(currentSection == "0"){
-        std::cout << "Assembler: ERROR -> calling beq outside of section!" << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> calling beq outside of section!" << endl;
+        throw AssemblerError();
     }
 
-    int gpr1 = general_register_string_to_index(params[0]);
-
-    int gpr2 = general_register_string_to_index(params[1]);
-
-    string operand = params[2];
-    char operandType = operand[operand.size() - 1];
-
-    // Remove operand type character from the string;
-    operand.erase(operand.size() - 1, 1);
-
-    int insCode = -1;
-    int lit = -1;
-    size_t plusPosition = -1;
-    
-    switch(operandType){
-        case '3': // literal
-            // beq [pc + 4]
-            // jmp 4
-            // 32 bit literal
-
-     
-            // beq [pc] -> if (gpr[B] == gpr[C]) pc<=mem32[gpr[A]+D];
-            insCode = (0x39F << 20) | (gpr1 << 16) | (gpr2 << 12) | 0x004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // literal
-            
-            lit = literal_to_int(operand);
-             // Insert into machine code;
-            insert_word_into_machine_code(lit);
-
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-
-            break;
-        case '4': // symbol
-            // we translate this to
-            // beq [pc + 4]
-            // jmp 4
-            // 32 bit symbol value
-
-            // beq [pc] -> if (gpr[B] == gpr[C]) pc<=mem32[gpr[A]+D];
-            insCode = (0x39F << 20) | (gpr1 << 16) | (gpr2 << 12) | 0x004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // add to symbol table if needed:
-            if(symbolTableMap.find(operand) == symbolTableMap.end()){
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, operand, false);
-
-                symbolTable.push_back(s);
-                symbolTableMap[s->name] = s;
-                // add to flink.
-                push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                // Insert zeroes into machine code;
-                insert_word_into_machine_code(0);
-            }
-            else{
-                if(symbolTableMap[operand]->type != WFI && symbolTableMap[operand]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[operand]->value);
-                }
-                else{
-                    // add to flink.
-                    push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                    // Insert zeroes into machine code;
-                    insert_word_into_machine_code(0);
-                }
-            }
+    // beq -> if (gpr[B] == gpr[C]) pc<=gpr[A]+D;
+    // beq [pc + D] -> if (gpr[B] == gpr[C]) pc<=mem32[gpr[A]+D];
+    // A = pc, D = distance to the target or to its address in the literal pool
+    int shortInsCode = (0x31F << 20) | (gpr1 << 16) | (gpr2 << 12);
+    int insCode = (0x39F << 20) | (gpr1 << 16) | (gpr2 << 12);
 
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-            break;
-       
-        default:
-            std::cout << "Assembler: ERROR -> Unknown operand type for jump instructions: " << operandType << endl;
-            exit(0);
-    };
+    insert_branch_instruction(shortInsCode, insCode, branch_target(target));
 }
 
-void Assembler::bne(vector<string> params)
+void Assembler::bne(int gpr1, int gpr2, Operand target)
 {
-   
     // Error Check
     if(currentSection == "0"){
-        std::cout << "Assembler: ERROR -> calling beq outside of section!" << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> calling bne outside of section!" << endl;
+        throw AssemblerError();
     }
 
-    int gpr1 = general_register_string_to_index(params[0]);
-    
-    int gpr2 = general_register_string_to_index(params[1]);
-
-    string operand = params[2];
-    char operandType = operand[operand.size() - 1];
-
-    // Remove operand type character from the string;
-    operand.erase(operand.size() - 1, 1);
-
-    int insCode = -1;
-    int lit = -1;
-    size_t plusPosition = -1;
-    
-    switch(operandType){
-        case '3': // literal
-            // bne [pc + 4]
-            // jmp 4
-            // 32 bit literal
+    // bne -> if (gpr[B] != gpr[C]) pc<=gpr[A]+D;
+    // bne [pc + D] -> if (gpr[B] != gpr[C]) pc<=mem32[gpr[A]+D];
+    // A = pc, D = distance to the target or to its address in the literal pool
+    int shortInsCode = (0x32F << 20) | (gpr1 << 16) | (gpr2 << 12);
+    int insCode = (0x3AF << 20) | (gpr1 << 16) | (gpr2 << 12);
 
-     
-            // bne [pc] -> if (gpr[B] != gpr[C]) pc<=mem32[gpr[A]+D];
-            insCode = (0x3AF << 20) | (gpr1 << 16) | (gpr2 << 12) | 0x004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-            
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // literal
-
-            lit = literal_to_int(operand);
-             // Insert into machine code;
-            insert_word_into_machine_code(lit);
-
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-
-            break;
-        case '4': // symbol
-            // we translate this to
-            // bne [pc + 4]
-            // jmp 4
-            // 32 bit symbol value
-
-            // bne [pc] -> if (gpr[B] != gpr[C]) pc<=mem32[gpr[A]+D];
-            insCode = (0x3AF << 20) | (gpr1 << 16) | (gpr2 << 12) | 0x004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // add to symbol table if needed:
-            if(symbolTableMap.find(operand) == symbolTableMap.end()){
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, operand, false);
-
-                symbolTable.push_back(s);
-                symbolTableMap[s->name] = s;
-                // add to flink.
-                push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                // Insert zeroes into machine code;
-                insert_word_into_machine_code(0);
-            }
-            else{
-                if(symbolTableMap[operand]->type != WFI && symbolTableMap[operand]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[operand]->value);
-                }
-                else{
-                    // add to flink.
-                    push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                    // Insert zeroes into machine code;
-                    insert_word_into_machine_code(0);
-                }
-            }
-
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-            break;
-       
-        default:
-            std::cout << "Assembler: ERROR -> Unknown operand type for jump instructions: " << operandType << endl;
-            exit(0);
-    };
+    insert_branch_instruction(shortInsCode, insCode, branch_target(target));
 }
 
-void Assembler::bgt(vector<string> params)
+void Assembler::bgt(int gpr1, int gpr2, Operand target)
 {
     // Error Check
     if(currentSection == "0"){
-        std::cout << "Assembler: ERROR -> calling beq outside of section!" << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> calling bgt outside of section!" << endl;
+        throw AssemblerError();
     }
 
-    int gpr1 = general_register_string_to_index(params[0]);
-    
-    int gpr2 = general_register_string_to_index(params[1]);
-
-    string operand = params[2];
-    char operandType = operand[operand.size() - 1];
-
-    // Remove operand type character from the string;
-    operand.erase(operand.size() - 1, 1);
-
-    int insCode = -1;
-    int lit = -1;
-    size_t plusPosition = -1;
-    
-    switch(operandType){
-        case '3': // literal
-            // bgt [pc + 4]
-            // jmp 4
-            // 32 bit literal
-
-     
-            // bgt [pc] -> if (gpr[B] signed> gpr[C]) pc<=mem32[gpr[A]+D];
-            insCode = (0x3BF << 20) | (gpr1 << 16) | (gpr2 << 12) | 0x004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-    
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // literal
-            
-            lit = literal_to_int(operand);
-             // Insert into machine code;
-            insert_word_into_machine_code(lit);
-
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-
-            break;
-        case '4': // symbol
-            // we translate this to
-            // bgt [pc + 4]
-            // jmp 4
-            // 32 bit symbol value
-
-            // bgt [pc] -> if (gpr[B] signed> gpr[C]) pc<=mem32[gpr[A]+D];
-            insCode = (0x3BF << 20) | (gpr1 << 16) | (gpr2 << 12) | 0x004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
+    // bgt -> if (gpr[B] signed> gpr[C]) pc<=gpr[A]+D;
+    // bgt [pc + D] -> if (gpr[B] signed> gpr[C]) pc<=mem32[gpr[A]+D];
+    // A = pc, D = distance to the target or to its address in the literal pool
+    int shortInsCode = (0x33F << 20) | (gpr1 << 16) | (gpr2 << 12);
+    int insCode = (0x3BF << 20) | (gpr1 << 16) | (gpr2 << 12);
 
-            // JMP pc + 4 -> pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            // Insert into machine code;
-            insert_word_into_machine_code(insCode);
-
-            // add to symbol table if needed:
-            if(symbolTableMap.find(operand) == symbolTableMap.end()){
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, operand, false);
-
-                symbolTable.push_back(s);
-                symbolTableMap[s->name] = s;
-                // add to flink.
-                push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                // Insert zeroes into machine code;
-                insert_word_into_machine_code(0);
-            }
-            else{
-                if(symbolTableMap[operand]->type != WFI && symbolTableMap[operand]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[operand]->value);
-                }
-                else{
-                    // add to flink.
-                    push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                    // Insert zeroes into machine code;
-                    insert_word_into_machine_code(0);
-                }
-            }
-
-            // Increase location counter.
-            locationCounter += 3 * WORD_SIZE;
-            break;
-       
-        default:
-            std::cout << "Assembler: ERROR -> Unknown operand type for jump instructions: " << operandType << endl;
-            exit(0);
-    };
+    insert_branch_instruction(shortInsCode, insCode, branch_target(target));
 }
 
 void Assembler::push(string param)
@@ -898,446 +531,216 @@ void Assembler::shr(vector<string> params)
     locationCounter += WORD_SIZE;
 }
 
-void Assembler::ld(vector<string> params)
+void Assembler::ld(Operand source, int gpr)
 {
   
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> ld attempted outside of section!" << endl;  
-        exit(0);
+        *messages << "assembler: ERROR -> ld attempted outside of section!" << endl;  
+        throw AssemblerError();
     }
-    int gpr = general_register_string_to_index(params[1]);
-    string operand = params[0];
-    char operandType = operand[operand.size() - 1];
-    operand.erase(operand.size() - 1, 1);
 
     int insCode = -1;
     int lit = -1;
-    int reg = -1;
-    size_t plusPosition = -1;
-    string sym = "";
-
-    switch(operandType){
-        case '1': // $literal
-            // gpr <= mem[pc + 4]
-            // jmp pc + 4
-            // literal
-
-            // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-            insCode = (0x92 << 24) | (gpr << 20) | (0xF0004);
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
+    LiteralPoolEntry entry(-1, 0);
 
-            //pc<=gpr[A]+D;
-            insCode = 0x30F00004;
+    switch(source.kind){
+        case OPERAND_IMMEDIATE_LITERAL:
+        case OPERAND_IMMEDIATE_SYMBOL:
+            entry = source.kind == OPERAND_IMMEDIATE_LITERAL ? literal_pool_constant(source.literal) : literal_pool_symbol(source.symbol);
 
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            // remove $.
-            operand.erase(0,1);
-
-            // literal
-               
-
-            lit = literal_to_int(operand);
-            
-            // Insert into machine code.
-            insert_word_into_machine_code(lit);
-
-            locationCounter += 3 * WORD_SIZE;
-            break;
-        case '2': // $symbol
-            // gpr <= mem[pc + 4]
-            // jmp pc + 4
-            // symbol value
-
-            // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-            insCode = (0x92 << 24) | (gpr << 20) | (0xF0004);
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            //pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            // remove $
-            operand.erase(0,1);
-
-            // symbol
-            if(symbolTableMap.find(operand) != symbolTableMap.end()){
-                if(symbolTableMap[operand]->type != WFI && symbolTableMap[operand]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[operand]->value);
-                }
-                else{
-                    insert_word_into_machine_code(0);
-                    push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
-                }
+            if(is_small_constant(entry)){
+                // gpr[A]<=gpr[B]+D;
+                // A = gpr, B = r0, D = value
+                insCode = (0x91 << 24) | (gpr << 20) | (entry.value & 0xFFF);
+                insert_word_into_machine_code(insCode);
+                locationCounter += WORD_SIZE;
             }
             else{
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, operand, false);
-                symbolTableMap[s->name] = s;
-                symbolTable.push_back(s);
-
-                insert_word_into_machine_code(0);
-
-                push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
+                // gpr <= mem[pc + D], the value is in the pool
+                // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
+                insCode = (0x92 << 24) | (gpr << 20) | (0xF << 16);
+                insert_literal_pool_instruction(insCode, entry);
             }
-            locationCounter += 3 * WORD_SIZE;
             break;
-        case '3': // literal
-            // ld %r1, [PC+8]
-            // ld %r1, [%r1]
-            // jmp pc+4
-            // literal
-
-            // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-            insCode = (0x92 << 24) | (gpr << 20) | (0xF0008);
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-            insCode = (0x92 << 24) | (gpr << 20) | (gpr << 16);
-            
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            //pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-            insert_word_into_machine_code(insCode);
-
-            // literal
-            lit = literal_to_int(operand);
-
-            // Insert into machine code.
-            insert_word_into_machine_code(lit);
+        case OPERAND_MEMORY_LITERAL:
+        case OPERAND_MEMORY_SYMBOL:
+            entry = source.kind == OPERAND_MEMORY_LITERAL ? literal_pool_constant(source.literal) : literal_pool_symbol(source.symbol);
+
+            if(is_small_constant(entry)){
+                // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
+                // A = gpr, B = r0, D = address
+                insCode = (0x92 << 24) | (gpr << 20) | (entry.value & 0xFFF);
+                insert_word_into_machine_code(insCode);
+                locationCounter += WORD_SIZE;
+                break;
+            }
 
-            locationCounter += 4 * WORD_SIZE;
-            break;
-        case '4': // symbol
-            // ld %r1, [PC+8]
+            // ld %r1, [pc + D] -> the address is in the pool
             // ld %r1, [%r1]
-            // jmp pc+4
-            // symbol value
 
             // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-            insCode = (0x92 << 24) | (gpr << 20) | (0xF0008);
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
+            insCode = (0x92 << 24) | (gpr << 20) | (0xF << 16);
+            insert_literal_pool_instruction(insCode, entry);
 
             // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
             insCode = (0x92 << 24) | (gpr << 20) | (gpr << 16);
-            
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            //pc<=gpr[A]+D;
-            insCode = 0x30F00004;
             insert_word_into_machine_code(insCode);
 
-            // symbol
-            if(symbolTableMap.find(operand) != symbolTableMap.end()){
-                if(symbolTableMap[operand]->type != WFI && symbolTableMap[operand]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[operand]->value);
-                }
-                else{
-                    insert_word_into_machine_code(0);
-                    push_to_flink(operand, -1, locationCounter + 3 * WORD_SIZE, PLUS, false);
-                }
-            }
-            else{
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, operand, false);
-                symbolTableMap[s->name] = s;
-                symbolTable.push_back(s);
-
-                insert_word_into_machine_code(0);
-
-                push_to_flink(operand, -1, locationCounter + 3 * WORD_SIZE, PLUS, false);
-            }
-
-            locationCounter += 4 * WORD_SIZE;
+            locationCounter += WORD_SIZE;
             break;
-        case '5': // %reg
-            reg = general_register_string_to_index(operand);
-
+        case OPERAND_REGISTER:
             // gpr[A]<=gpr[B]+D
             // A = gpr, B = reg
-            insCode = (0x92 << 24) | (gpr << 20) | (reg << 16);
+            insCode = (0x91 << 24) | (gpr << 20) | (source.reg << 16);
             // Insert into machine code.
             insert_word_into_machine_code(insCode);
             locationCounter += WORD_SIZE;
             break;
-        case '6': //[%reg]
-            operand.erase(0,1);
-            operand.erase(operand.size() - 1, 1);
-            reg = general_register_string_to_index(operand);
-
+        case OPERAND_REGISTER_INDIRECT:
             // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
             // A = gpr, B = reg, C = 0, D = 0
-            insCode = (0x92 << 24) | (gpr << 20) | (reg << 16);
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-            locationCounter += WORD_SIZE;
-            break;
-        case '7': //  [%reg + literal]
-
-            operand.erase(0,1);
-            operand.erase(operand.size() - 1, 1); 
-
-            plusPosition = operand.find('+');
-
-            reg = general_register_string_to_index(operand.substr(0,plusPosition));
-            
-            lit = literal_to_int(operand.substr(plusPosition + 1));
-            
-            if(lit > 2047 || lit < -2048){
-                std::cout << "Assembler: ERROR -> ld [%reg + literal] literal bigger than 12 bits" << endl;
-                exit(0);
-            }
-
-            // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-            // A = gpr, B = reg, C = 0, D = literal
-          
-            insCode = (0x92 << 24) | (gpr << 20) | (reg << 16) | lit;
+            insCode = (0x92 << 24) | (gpr << 20) | (source.reg << 16);
             // Insert into machine code.
             insert_word_into_machine_code(insCode);
-
-            locationCounter += WORD_SIZE;
-            break;
-        case '8':
-            operand.erase(0,1);
-            operand.erase(operand.size() - 1, 1); 
-
-            plusPosition = operand.find('+');
-
-            reg = general_register_string_to_index(operand.substr(0,plusPosition));
-            sym = operand.substr(plusPosition + 1);
-
-            if(symbolTableMap.find(sym) != symbolTableMap.end()){
-                if(symbolTableMap[sym]->type != WFI && symbolTableMap[sym]->equ == true){
-                    if((symbolTableMap[sym]->value > 2047 || symbolTableMap[sym]->value < -2048)){
-                        // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
-                        // A = gpr, B = reg, C = 0, D = symbolValue
-                    
-                        insCode = (0x92 << 24) | (gpr << 20) | (reg << 16) | symbolTableMap[sym]->value;
-
-                        // Insert into machine code.
-                        insert_word_into_machine_code(insCode);
-                    }
-                    else{
-                        std::cout << "Assembler: ERROR -> ld [%reg + symbol] symbol value bigger than 12 bits" << endl;
-                        exit(0);
-                    }
-                }
-                else{
-                     insCode = (0x92 << 24) | (gpr << 20) | (reg << 16);
-                    // Insert into machine code.
-                    insert_word_into_machine_code(insCode);
-
-                    push_to_flink(sym, -1, locationCounter, PLUS, true);
-                }
-            }
-            else{
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, sym, false);
-                symbolTableMap[s->name] = s;
-                symbolTable.push_back(s);
-
-                insCode = (0x92 << 24) | (gpr << 20) | (reg << 16);
-                // Insert into machine code.
-                insert_word_into_machine_code(insCode);
-                push_to_flink(sym, -1, locationCounter, PLUS, true);
-            }
-
             locationCounter += WORD_SIZE;
             break;
-        default:
-            std::cout << "Assembler: ERROR -> ld unknown operand type" << endl;
-            exit(0);
-    };
-}
-
-void Assembler::st(vector<string> params)
-{
-    // Error
-    if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> st attempted outside of section!" << endl;  
-        exit(0);
-    }
-
-    int gpr = general_register_string_to_index(params[0]);
-    string operand = params[1];
-    char operandType = operand[operand.size() - 1];
-    operand.erase(operand.size() - 1, 1);
-
-    int insCode = -1;
-    int lit = -1;
-    int reg = -1;
-    size_t plusPosition = -1;
-    string sym = "";
-
-    switch(operandType){
-        case '1': // $literal
-            std::cout << "Assembler: ERROR -> Illegal addressing st $literal " << endl;
-            exit(0);
-        case '2': // $symbol
-            std::cout << "Assembler: ERROR -> Illegal addressing st $symbol " << endl;
-            exit(0);
-        case '3': // literal
-            // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
-            // jmp pc + 4
-            // literal
-            
-            // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
-            insCode = (0x82F0 << 16) | (gpr << 12) | 0x004;
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            //pc<=gpr[A]+D;
-            insCode = 0x30F00004;
-
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
-
-            // literal
-            lit = literal_to_int(operand);
-
-            // Insert into machine code.
-            insert_word_into_machine_code(lit);
-
-            locationCounter += 3 * WORD_SIZE;
-            break;
-        case '4': // symbol
-            // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
-            // jmp pc + 4
-            // symbol value
-
-            // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
-            insCode = (0x82F0 << 16) | (gpr << 12) | 0x004;
+        case OPERAND_REGISTER_LITERAL:
+            lit = source.literal;
+            
+            if(lit > DISPLACEMENT_MAX || lit < DISPLACEMENT_MIN){
+                *messages << "Assembler: ERROR -> ld [%reg + literal] literal bigger than 12 bits" << endl;
+                throw AssemblerError();
+            }
 
+            // gpr[A]<=mem32[gpr[B]+gpr[C]+D];
+            // A = gpr, B = reg, C = 0, D = literal
+          
+            insCode = (0x92 << 24) | (gpr << 20) | (source.reg << 16) | (lit & 0xFFF);
             // Insert into machine code.
             insert_word_into_machine_code(insCode);
 
-            //pc<=gpr[A]+D;
-            insCode = 0x30F00004;
+            locationCounter += WORD_SIZE;
+            break;
+        case OPERAND_REGISTER_SYMBOL:
 
-            // Insert into machine code.
-            insert_word_into_machine_code(insCode);
+            insCode = (0x92 << 24) | (gpr << 20) | (source.reg << 16);
 
+            if(symbolTable[source.symbol].ndx == ABS){
+                lit = symbolTable[source.symbol].value;
 
-            // symbol
-            if(symbolTableMap.find(operand) != symbolTableMap.end()){
-                if(symbolTableMap[operand]->type != WFI && symbolTableMap[operand]->equ == true){
-                    insert_word_into_machine_code(symbolTableMap[operand]->value);
-                }
-                else{
-                    insert_word_into_machine_code(0);
-                    push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
+                if(lit > DISPLACEMENT_MAX || lit < DISPLACEMENT_MIN){
+                    *messages << "Assembler: ERROR -> ld [%reg + symbol] symbol value bigger than 12 bits" << endl;
+                    throw AssemblerError();
                 }
+
+                // D = symbol value
+                insert_word_into_machine_code(insCode | (lit & 0xFFF));
             }
             else{
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, operand, false);
-                symbolTableMap[s->name] = s;
-                symbolTable.push_back(s);
+                // D is filled in once the constant is known
+                insert_word_into_machine_code(insCode);
+                push_to_flink(source.symbol, -1, locationCounter, PLUS, true);
+            }
 
-                insert_word_into_machine_code(0);
+            locationCounter += WORD_SIZE;
+            break;
+        default:
+            *messages << "Assembler: ERROR -> ld unknown operand type" << endl;
+            throw AssemblerError();
+    };
+}
+
+void Assembler::st(int gpr, Operand destination)
+{
+    // Error
+    if (currentSection == "0"){
+        *messages << "assembler: ERROR -> st attempted outside of section!" << endl;  
+        throw AssemblerError();
+    }
 
-                push_to_flink(operand, -1, locationCounter + 2 * WORD_SIZE, PLUS, false);
+    int insCode = -1;
+    int lit = -1;
+    LiteralPoolEntry entry(-1, 0);
+
+    switch(destination.kind){
+        case OPERAND_IMMEDIATE_LITERAL:
+            *messages << "Assembler: ERROR -> Illegal addressing st $literal " << endl;
+            throw AssemblerError();
+        case OPERAND_IMMEDIATE_SYMBOL:
+            *messages << "Assembler: ERROR -> Illegal addressing st $symbol " << endl;
+            throw AssemblerError();
+        case OPERAND_MEMORY_LITERAL:
+        case OPERAND_MEMORY_SYMBOL:
+            entry = destination.kind == OPERAND_MEMORY_LITERAL ? literal_pool_constant(destination.literal) : literal_pool_symbol(destination.symbol);
+
+            if(is_small_constant(entry)){
+                // mem32[gpr[A]+gpr[B]+D]<=gpr[C];
+                // A = r0, B = r0, C = gpr, D = address
+                insCode = (0x80 << 24) | (gpr << 12) | (entry.value & 0xFFF);
+                insert_word_into_machine_code(insCode);
+                locationCounter += WORD_SIZE;
+            }
+            else{
+                // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
+                // A = pc, C = gpr, D = distance to the address in the literal pool
+                insCode = (0x82F0 << 16) | (gpr << 12);
+                insert_literal_pool_instruction(insCode, entry);
             }
-            locationCounter += 3 * WORD_SIZE;
             break;
-        case '5': // %reg
-            std::cout << "Assembler: ERROR -> Illegal addressing st %reg " << endl;
-            exit(0);
-        case '6': //[%reg]
-            operand.erase(0,1);
-            operand.erase(operand.size() - 1, 1);
-            reg = general_register_string_to_index(operand);
-          
+        case OPERAND_REGISTER:
+            *messages << "Assembler: ERROR -> Illegal addressing st %reg " << endl;
+            throw AssemblerError();
+        case OPERAND_REGISTER_INDIRECT:
             // mem32[gpr[A]+gpr[B]+D]<=gpr[C];
             // A = reg, B = 0, C = gpr, D = 0
-            insCode = (0x80 << 24) | (reg << 20) | (gpr << 12);
+            insCode = (0x80 << 24) | (destination.reg << 20) | (gpr << 12);
             // Insert into machine code.
             insert_word_into_machine_code(insCode);
             locationCounter += WORD_SIZE;
             break;
-        case '7': //  [%reg + literal]
-            operand.erase(0,1);
-            operand.erase(operand.size() - 1, 1); 
+        case OPERAND_REGISTER_LITERAL:
+            lit = destination.literal;
 
-            plusPosition = operand.find('+');
-
-            reg = general_register_string_to_index(operand.substr(0,plusPosition));
-            lit = literal_to_int(operand.substr(plusPosition + 1));
-
-            if(lit > 2047 || lit < -2048){
-                std::cout << "Assembler: ERROR -> ld [%reg + literal] literal bigger than 12 bits" << endl;
-                exit(0);
+            if(lit > DISPLACEMENT_MAX || lit < DISPLACEMENT_MIN){
+                *messages << "Assembler: ERROR -> ld [%reg + literal] literal bigger than 12 bits" << endl;
+                throw AssemblerError();
             }
 
             // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
             // A = reg, B = 0, C = gpr, D = lit
-            insCode = (0x82 << 24) | (reg << 20) | (gpr << 12) | lit;
+            insCode = (0x82 << 24) | (destination.reg << 20) | (gpr << 12) | (lit & 0xFFF);
             // Insert into machine code.
             insert_word_into_machine_code(insCode);
 
             locationCounter += WORD_SIZE;
             break;
-        case '8':
-            operand.erase(0,1);
-            operand.erase(operand.size() - 1, 1); 
+        case OPERAND_REGISTER_SYMBOL:
 
-            plusPosition = operand.find('+');
+            insCode = (0x82 << 24) | (destination.reg << 20) | (gpr << 12);
 
-            reg = general_register_string_to_index(operand.substr(0,plusPosition));
-            sym = operand.substr(plusPosition + 1);
+            if(symbolTable[destination.symbol].ndx == ABS){
+                lit = symbolTable[destination.symbol].value;
 
-            if(symbolTableMap.find(sym) != symbolTableMap.end()){
-                if(symbolTableMap[sym]->type != WFI && symbolTableMap[sym]->equ == true){
-                    if(symbolTableMap[sym]->value > 2047 || symbolTableMap[sym]->value < -2048){
-                        // mem32[mem32[gpr[A]+gpr[B]+D]]<=gpr[C];
-                        // A = reg, B = 0, C = gpr, D = symbol value
-                        insCode = (0x82 << 24) | (reg << 20) | (gpr << 12) | symbolTableMap[sym]->value;
-                        // Insert into machine code.
-                        insert_word_into_machine_code(insCode);
-
-                    }
-                    else{
-                        std::cout << "Assembler: ERROR -> st [%reg + symbol] symbol value bigger than 12 bits" << endl;
-                        exit(0);
-                    }
+                if(lit > DISPLACEMENT_MAX || lit < DISPLACEMENT_MIN){
+                    *messages << "Assembler: ERROR -> st [%reg + symbol] symbol value bigger than 12 bits" << endl;
+                    throw AssemblerError();
                 }
-                else{
-                    insCode = (0x82 << 24) | (reg << 20) | (gpr << 12);
-                    // Insert into machine code.
-                    insert_word_into_machine_code(insCode);
 
-                    push_to_flink(sym, -1, locationCounter, PLUS, true);
-                }
+                // D = symbol value
+                insert_word_into_machine_code(insCode | (lit & 0xFFF));
             }
             else{
-                SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, 0, 0, WFI, LOC, UND, sym, false);
-                symbolTableMap[s->name] = s;
-                symbolTable.push_back(s);
-
-                insCode = (0x82 << 24) | (reg << 20) | (gpr << 12);
-                // Insert into machine code.
+                // D is filled in once the constant is known
                 insert_word_into_machine_code(insCode);
-
-                push_to_flink(sym, -1, locationCounter, PLUS, true);
+                push_to_flink(destination.symbol, -1, locationCounter, PLUS, true);
             }
 
             locationCounter += WORD_SIZE;
             break;
         default:
-            std::cout << "Assembler: ERROR -> st unknown operand type" << endl;
-            exit(0);
+            *messages << "Assembler: ERROR -> st unknown operand type" << endl;
+            throw AssemblerError();
     };
 }
 
@@ -1374,26 +777,26 @@ void Assembler::label(string param)
 {
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> generating label is not allowed outside of section!" << endl;  
-        exit(0);
+        *messages << "assembler: ERROR -> generating label is not allowed outside of section!" << endl;  
+        throw AssemblerError();
     }
 
     // erase :
     param.erase(param.size() - 1, 1);
 
-    // add to symbol table if needed:
-    if(symbolTableMap.find(param) == symbolTableMap.end()){
-        SymbolTableRow* s = new SymbolTableRow(symbolTable.back()->num + 1, locationCounter, 0, NOTYP, LOC, symbolTableMap[currentSection]->ndx, param, false);
+    int id = intern_symbol(param);
+    SymbolTableRow& symbol = symbolTable[id];
 
-        symbolTable.push_back(s);
-        symbolTableMap[s->name] = s;
-    } else if(symbolTableMap[param]->type == WFI){
-        symbolTableMap[param]->value = locationCounter;
-        symbolTableMap[param]->ndx = symbolTableMap[currentSection]->ndx;
-        symbolTableMap[param]->type = NOTYP;
+    if(symbol.type == WFI){
+        symbol.value = locationCounter;
+        symbol.ndx = symbolTable[sectionTable[currentSection]->symbol].ndx;
+        symbol.type = NOTYP;
+
+        resolve_branches(id);
+        symbol_defined(id);
     } else {
-        std::cout <<"Assembler: ERROR -> Re-initialization of symbol " << param << endl;
-        exit(0);
+        *messages <<"Assembler: ERROR -> Re-initialization of symbol " << param << endl;
+        throw AssemblerError();
     }
 }
 
@@ -1402,75 +805,73 @@ void Assembler::set_output_file(char *name)
     this->outputFileName = string(name);
 }
 
+/**
+ * One pass over the flink of every section. Constants are written into the machine code,
+ * everything else gets a relocation. Pc relative references to labels of the same section
+ * were already resolved when the label was defined (resolve_branches), what is left here are
+ * absolute addresses, and those depend on where the linker places the section.
+ */
 void Assembler::generate_relocation_tables()
 {
     for (const auto& pair : sectionTable) {
         // pick section
-        string sectionName = pair.first;
         SectionDefinition* sectionDefinition = pair.second;
-        vector<FLinkRow*> table = sectionDefinition->fLinkTable;
+        vector<RelocationTableRow*>& relocations = relocationTables[symbolTable[sectionDefinition->symbol].ndx];
 
         // traverse through flink
-        for(FLinkRow* row: table){
-            string symName = row->symbolIdentifier;
+        for(FLinkRow* row: sectionDefinition->fLinkTable){
+            SymbolTableRow& symbol = symbolTable[row->symbol];
+
+            // what every action of the row gets, relocation symbol and addend
+            int relocationSymbol = -1;
+            int addend = 0;
+
+            if(symbol.ndx == ABS){
+                // folded below
+            } else if(symbol.equ == true && equTable[row->symbol]->base != -1){
+                // address of an external symbol plus a constant
+                relocationSymbol = symbolTable[equTable[row->symbol]->base].num;
+                addend = symbol.value;
+            } else if(symbol.bind == LOC){
+                if(symbol.ndx == UND){
+                    *messages <<"Assembler: ERROR -> symbol "
+                        << symbol.name << " has bind LOC and ndx UND during relocation table generation." << endl;
+                    throw AssemblerError();
+                }
+
+                relocationSymbol = symbolTable[section_symbol(symbol.ndx)].num;
+                addend = symbol.value;
+            } else if(symbol.bind == GLOB){
+                relocationSymbol = symbol.num;
+            } else {
+                *messages << "Assembler: ERROR -> unkown symbol bind " << symbol.bind
+                    << " for symbol: " << symbol.name << endl;
+                throw AssemblerError();
+            }
 
             // traverse through actions
-            for(FLinkAction action: row->fLinkAction){
+            for(FLinkAction* action = row->firstAction; action != nullptr; action = action->next){
+
+                // constants fold into the machine code
+                if(action->st8Relocation == true){
+                    int value = symbol.value;
 
-                if(action.st8Relocation == true){
-                    if(symbolTableMap[symName]->type == WFI){
-                        std::cout << "Assembler: ERROR -> call8Relocation not possible: symbol "
-                            << symName << " hasn't been defined completely during assembling." << endl;
-                        exit(0);
+                    if(symbol.ndx != ABS || value > DISPLACEMENT_MAX || value < DISPLACEMENT_MIN){
+                        *messages << "Assembler: ERROR -> [%reg + symbol] needs a constant that fits 12 bits: symbol "
+                            << symbol.name << endl;
+                        throw AssemblerError();
                     }
-                    else{
-                        std::cout << "Assembler: ERROR -> impossible(not yet implemented) branch 1 reached during relocation table generation. " << endl;
-                        exit(0);
-                        // todo: implement this if equ is implemented.
+
+                    sectionDefinition->data[action->address] |= value & 0xFF;
+                    sectionDefinition->data[action->address + 1] |= (value >> 8) & 0x0F;
+                } else if(symbol.ndx == ABS){
+                    int value = symbol.value;
+
+                    for(int i = 0; i < WORD_SIZE; i ++){
+                        sectionDefinition->data[action->address + i] = (value >> (i * 8)) & 0xFF;
                     }
                 } else {
-                    if(symbolTableMap[symName]->bind == LOC ){
-                        
-                        if(symbolTableMap[symName]->ndx == UND){
-                            std::cout <<"Assembler: ERROR -> equ not implemented: symbol "
-                                << symName << " has bind LOC and ndx UND during relocation table generation." << endl;
-                            exit(0);
-                        }
-                        
-                        // find section num
-                        int sectionNdx = symbolTableMap[symName]->ndx;
-                        int sectionNumTemp = -1;
-                        for (const auto& pair2 : sectionTable){
-                            string sectionName2 = pair2.first;
-                            if(symbolTableMap[sectionName2]->ndx == sectionNdx){
-                                sectionNumTemp = symbolTableMap[sectionName2]->num;
-                                break;
-                            }
-                        }
-
-                        relocationTables[symbolTableMap[sectionDefinition->name]->ndx].push_back(
-                            new RelocationTableRow(
-                                action.address, 
-                                DEFAULT_32_TYPE, 
-                                sectionNumTemp, 
-                                symbolTableMap[symName]->value
-                            )
-                        );
-                    }
-                    else if(symbolTableMap[symName]->bind == GLOB){
-                        relocationTables[symbolTableMap[sectionDefinition->name]->ndx].push_back(
-                            new RelocationTableRow(
-                                action.address, 
-                                DEFAULT_32_TYPE, 
-                                symbolTableMap[symName]->num, 
-                                0
-                            )
-                        );        
-                    } else {
-                        std::cout << "Assembler: ERROR -> unkown symbol bind " << symbolTableMap[symName]->bind
-                            << " for symbol: " << symName << endl;
-                        exit(0);
-                    }
+                    relocations.push_back(arena.create<RelocationTableRow>(action->address, DEFAULT_32_TYPE, relocationSymbol, addend));
                 }
             }
         }
@@ -1540,30 +941,30 @@ void Assembler::generate_elf_file()
     unordered_map<string, pair<vector<Elf32_Byte>, Elf32_Shdr>> codeSections;
     unordered_map<string, pair<vector<Elf32_Rela>, Elf32_Shdr>> relaSections;
 
-    for(SymbolTableRow* s: symbolTable){
-        if(s->num == 0){
+    for(SymbolTableRow& s: symbolTable){
+        if(s.num == 0){
             continue;
         }
 
-        if(s->type == WFI){
-            std::cout <<"Assembler: ERROR -> Symbol " << s->name << " not yet defined at the end of assembling." << endl;
-            exit(0);
+        if(s.type == WFI){
+            *messages <<"Assembler: ERROR -> Symbol " << s.name << " not yet defined at the end of assembling." << endl;
+            throw AssemblerError();
         }
 
         // put in symtab data
         Elf32_Sym newSectionSym;
 
         // name 
-        for(char c: s->name){
+        for(char c: s.name){
             strtabData.push_back(c);
         }
         strtabData.push_back(0);
         newSectionSym.st_name = strtabLocationCounter;
-        strtabLocationCounter += s->name.size() + 1;
+        strtabLocationCounter += s.name.size() + 1;
 
         // type and bind
-        Elf32_Word bind = s->bind == LOC? STB_LOCAL: STB_GLOBAL;
-        Elf32_Word type = s->type == NOTYP? STT_NOTYPE: STT_SECTION;
+        Elf32_Word bind = s.bind == LOC? STB_LOCAL: STB_GLOBAL;
+        Elf32_Word type = s.type == NOTYP? STT_NOTYPE: STT_SECTION;
 
         newSectionSym.st_info = ELF32_ST_INFO(bind, type);
 
@@ -1571,59 +972,62 @@ void Assembler::generate_elf_file()
         newSectionSym.st_other = 0;
 
         // shndx
-        if(s->ndx == EXT){
+        if(s.ndx == EXT){
             newSectionSym.st_shndx = 0;
         }
-        else if(s->ndx == UND){
+        else if(s.ndx == UND){
             newSectionSym.st_shndx = -1;
         }
+        else if(s.ndx == ABS){
+            newSectionSym.st_shndx = SHN_ABS;
+        }
         else{
             // * 2 to compensate for rela, and + 3 to compensate for first 3 sections which are info sections;
-            newSectionSym.st_shndx = (s->ndx - 1) * 2 + 3;  
+            newSectionSym.st_shndx = (s.ndx - 1) * 2 + 3;  
         }
 
         // value
-        newSectionSym.st_value = s->value;
+        newSectionSym.st_value = s.value;
 
         // size
-        newSectionSym.st_size = s->size;
+        newSectionSym.st_size = s.size;
 
         // push
         symtabData.push_back(newSectionSym);
     
         // if its a section we got to have additional stuff.
-        if(s->type == SCTN){
+        if(s.type == SCTN){
             // make code section
-            vector<Elf32_Byte> machineCode = sectionTable[s->name]->data;
+            vector<Elf32_Byte> machineCode = sectionTable[s.name]->data;
 
             // make section header.
             Elf32_Shdr newSectionHeader;
             newSectionHeader.sh_name = shstrtabLocationCounter;
 
-            for(char c: s->name){
+            for(char c: s.name){
                 shstrtabData.push_back(c);
             }
             shstrtabData.push_back(0);
-            shstrtabLocationCounter += s->name.size() + 1;
+            shstrtabLocationCounter += s.name.size() + 1;
 
             
             newSectionHeader.sh_type = SHT_MACHINECODE;
             newSectionHeader.sh_flags = 0;
             newSectionHeader.sh_addr = 0;
             newSectionHeader.sh_offset = -1; // todo
-            newSectionHeader.sh_size = sectionTable[s->name]->length;
+            newSectionHeader.sh_size = sectionTable[s.name]->length;
             newSectionHeader.sh_link = 0;
             newSectionHeader.sh_info = 0;
             newSectionHeader.sh_addralign = 0;
             newSectionHeader.sh_entsize = 0;
 
-            codeSections[s->name].first = machineCode;
-            codeSections[s->name].second = newSectionHeader;
+            codeSections[s.name].first = machineCode;
+            codeSections[s.name].second = newSectionHeader;
 
 
             // rela
             vector<Elf32_Rela> newRelaTable;
-            vector<RelocationTableRow*> oldRelaTable = relocationTables[s->ndx];
+            vector<RelocationTableRow*>& oldRelaTable = relocationTables[s.ndx];
 
             for(RelocationTableRow* rtr: oldRelaTable){
                 Elf32_Rela newRela;
@@ -1636,7 +1040,7 @@ void Assembler::generate_elf_file()
             Elf32_Shdr newSectionHeaderRela;
 
             newSectionHeaderRela.sh_name = shstrtabLocationCounter;
-            string newSectionHeaderRelaName = string(".rela.") + s->name;
+            string newSectionHeaderRelaName = string(".rela.") + s.name;
     
             for(char c: newSectionHeaderRelaName){
                 shstrtabData.push_back(c);
@@ -1656,8 +1060,8 @@ void Assembler::generate_elf_file()
             newSectionHeaderRela.sh_addralign = 0;
             newSectionHeaderRela.sh_entsize = RELA_TABLE_ENTRY_SIZE;
 
-            relaSections[s->name].first = newRelaTable;
-            relaSections[s->name].second = newSectionHeaderRela;
+            relaSections[s.name].first = newRelaTable;
+            relaSections[s.name].second = newSectionHeaderRela;
         }
     }
 
@@ -1701,9 +1105,9 @@ void Assembler::generate_elf_file()
 
     //index of last loc symbol
     int tempSymIndex = -1;
-    for(SymbolTableRow* str2: symbolTable){
-        if(str2->bind == LOC){
-            tempSymIndex = str2->num;
+    for(SymbolTableRow& str2: symbolTable){
+        if(str2.bind == LOC){
+            tempSymIndex = str2.num;
         }
     }
     symtabHeader.sh_info = tempSymIndex + 1;
@@ -1713,11 +1117,11 @@ void Assembler::generate_elf_file()
     // other sections
     int offsetCounter = symtabHeader.sh_offset + symtabHeader.sh_size;
 
-    for (SymbolTableRow* strTemp2: symbolTable) {
-        if(strTemp2->type != SCTN){
+    for (SymbolTableRow& strTemp2: symbolTable) {
+        if(strTemp2.type != SCTN){
             continue;
         }
-        string sectionName = strTemp2->name;
+        string sectionName = strTemp2.name;
         
         // machine
         Elf32_Shdr* sectionHeaderTemp = &(codeSections[sectionName].second);
@@ -1739,8 +1143,8 @@ void Assembler::generate_elf_file()
     ofstream outFile(fileName, std::ios::out | std::ios::trunc);
 
     if (!outFile) {
-        std::cout << "Assembler: ERROR -> Could not generate an elf file." << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> Could not generate an elf file." << endl;
+        throw AssemblerError();
     }
 
     // write elf header
@@ -1799,11 +1203,11 @@ void Assembler::generate_elf_file()
     write_to_file_4bytes_little_endian(outFile, symtabHeader.sh_entsize);
 
     // write other section headers.
-    for (SymbolTableRow* strTemp3: symbolTable) {
-        if(strTemp3->type != SCTN){
+    for (SymbolTableRow& strTemp3: symbolTable) {
+        if(strTemp3.type != SCTN){
             continue;
         }
-        string sectionName = strTemp3->name;
+        string sectionName = strTemp3.name;
 
         // machine
         Elf32_Shdr sectionHeaderTemp = codeSections[sectionName].second;
@@ -1851,36 +1255,62 @@ void Assembler::generate_elf_file()
         write_to_file_4bytes_little_endian(outFile, symtabData[i].st_size);
     }
 
-    for(SymbolTableRow* tempstr: symbolTable){
-        if(tempstr->type != SCTN){
+    for(SymbolTableRow& tempstr: symbolTable){
+        if(tempstr.type != SCTN){
             continue;
         }
 
-        for(int i = 0; i < codeSections[tempstr->name].first.size(); i ++){
-            outFile << hex << setw(2) << setfill('0') << static_cast<int>(codeSections[tempstr->name].first[i]);
+        for(int i = 0; i < codeSections[tempstr.name].first.size(); i ++){
+            outFile << hex << setw(2) << setfill('0') << static_cast<int>(codeSections[tempstr.name].first[i]);
 
         }
       
-        for(int i = 0; i < relaSections[tempstr->name].first.size(); i ++){
+        for(int i = 0; i < relaSections[tempstr.name].first.size(); i ++){
             
-            write_to_file_4bytes_little_endian(outFile, relaSections[tempstr->name].first[i].r_offset);
-            write_to_file_4bytes_little_endian(outFile, relaSections[tempstr->name].first[i].r_info);
-            write_to_file_4bytes_little_endian(outFile, relaSections[tempstr->name].first[i].r_addend);
+            write_to_file_4bytes_little_endian(outFile, relaSections[tempstr.name].first[i].r_offset);
+            write_to_file_4bytes_little_endian(outFile, relaSections[tempstr.name].first[i].r_info);
+            write_to_file_4bytes_little_endian(outFile, relaSections[tempstr.name].first[i].r_addend);
         }
         
     }
 
     outFile.close();
 
-    std::cout << "Assembler: ELF file generated!" << endl;
+    *messages << "Assembler: ELF file generated!" << endl;
 }
 
 void Assembler::check_symbols_at_the_end()
 {
-    for(SymbolTableRow* sTemp: symbolTable){
-        if(sTemp->type == WFI){
-            cout << "Assembler: ERROR -> symbol " << sTemp->name << "left undefined" << endl;
-            exit(0);
+    // .global symbol that was never defined here is defined in another file
+    // (by index: resolving a .equ may intern new names)
+    for(int i = 0; i < symbolTable.size(); i ++){
+        if(symbolTable[i].type == WFI && symbolTable[i].bind == GLOB && symbolTable[i].equ == false){
+            symbolTable[i].type = NOTYP;
+            symbolTable[i].ndx = EXT;
+            symbol_defined(i);
+        }
+    }
+
+    for(SymbolTableRow& sTemp: symbolTable){
+        if(sTemp.equ == false){
+            continue;
+        }
+
+        if(sTemp.type == WFI){
+            *messages << "Assembler: ERROR -> .equ " << sTemp.name << " could not be resolved: undefined symbol or circular definition" << endl;
+            throw AssemblerError();
+        }
+
+        if(sTemp.bind == GLOB && sTemp.ndx == UND){
+            *messages << "Assembler: ERROR -> global symbol " << sTemp.name << " is an alias of an external symbol" << endl;
+            throw AssemblerError();
+        }
+    }
+
+    for(SymbolTableRow& sTemp: symbolTable){
+        if(sTemp.type == WFI){
+            *messages << "Assembler: ERROR -> symbol " << sTemp.name << "left undefined" << endl;
+            throw AssemblerError();
         }
     }
 }
@@ -1890,15 +1320,15 @@ void Assembler::edit_section_sizes_in_table_at_the_end()
     for(const auto& pair: sectionTable){
         string sectionName = pair.first;
         int sectionSize = pair.second->length;
-        symbolTableMap[sectionName]->size = sectionSize;
+        symbolTable[pair.second->symbol].size = sectionSize;
     }
 }
 
 void Assembler::printSymbolTable()
 {
-    std::cout << endl << "SYMBOL TABLE:" << endl << endl;
+    *messages << endl << "SYMBOL TABLE:" << endl << endl;
     // Print table header
-    std::cout << left << setw(5) << "Num"
+    *messages << left << setw(5) << "Num"
         << left << setw(10) << "Value"
         << left << setw(10) << "Size"
         << left << setw(10) << "Type"
@@ -1907,39 +1337,39 @@ void Assembler::printSymbolTable()
         << left << setw(15) << "Name"
         << left << setw(10) << "Equ" << endl;
 
-    std::cout << string(60, '-') << endl;  // Print a line for separation
+    *messages << string(60, '-') << endl;  // Print a line for separation
 
     // Print each row in the table
     for (const auto& row : symbolTable) {
-        std::cout << left << setw(5) << dec << row->num
-            << left << setw(10) << dec << row->value
-            << left << setw(10) << dec << row->size
-            << left << setw(10) << (row->type == NOTYP ? "NOTYP" :
-                                    (row->type == WFI? "WFI":"SCTN") )
-            << left << setw(10) << (row->bind == LOC ? "LOC" : "GLOB")
-            << left << setw(5) << (row->ndx == UND ? "UND" : (row->ndx == EXT? "EXT":to_string(row->ndx)))
-            << left << setw(15) << row->name 
-            << left << setw(15) << (row->equ == true? "true":"false") << endl;
+        *messages << left << setw(5) << dec << row.num
+            << left << setw(10) << dec << row.value
+            << left << setw(10) << dec << row.size
+            << left << setw(10) << (row.type == NOTYP ? "NOTYP" :
+                                    (row.type == WFI? "WFI":"SCTN") )
+            << left << setw(10) << (row.bind == LOC ? "LOC" : "GLOB")
+            << left << setw(5) << (row.ndx == UND ? "UND" : (row.ndx == EXT? "EXT": (row.ndx == ABS? "ABS":to_string(row.ndx))))
+            << left << setw(15) << row.name 
+            << left << setw(15) << (row.equ == true? "true":"false") << endl;
     }
-    std::cout << "___________________________________________________" << endl << endl;
+    *messages << "___________________________________________________" << endl << endl;
 }
 
 void Assembler::printSectionTable()
 {
-    std::cout << endl << "SECTION TABLE:" << endl << endl;
+    *messages << endl << "SECTION TABLE:" << endl << endl;
      // Print table header
-    std::cout << left << setw(15) << "Name"
+    *messages << left << setw(15) << "Name"
         << left << setw(10) << "Base"
         << left << setw(10) << "Length"
         << "Data" << endl;
 
-    std::cout << string(50, '-') << endl;  // Print a line for separation
+    *messages << string(50, '-') << endl;  // Print a line for separation
 
     // Print each section in the table
     for (const auto& entry : sectionTable) {
         const SectionDefinition* section = entry.second;
 
-        std::cout << left << setw(15) << section->name
+        *messages << left << setw(15) << section->name
             << left << setw(10) << dec << section->base
             << left << setw(10) << dec << section->length;
 
@@ -1947,36 +1377,36 @@ void Assembler::printSectionTable()
         const size_t dataSize = section->data.size();
         for (size_t i = 0; i < dataSize; ++i) {
             if (i > 0 && i % 8 == 0) {
-                std::cout << endl << setw(35) << setfill(' ') << "";  // Align data to the right under the Data header
+                *messages << endl << setw(35) << setfill(' ') << "";  // Align data to the right under the Data header
             }
             
             if(static_cast<int>(static_cast<unsigned char>(section->data[i])) < 16){
-                std::cout << "0";
+                *messages << "0";
             }
-            std::cout << uppercase << hex << static_cast<int>(static_cast<unsigned char>(section->data[i])) << " ";
+            *messages << uppercase << hex << static_cast<int>(static_cast<unsigned char>(section->data[i])) << " ";
         }
-        std::cout << endl;
+        *messages << endl;
     }
-    std::cout << "___________________________________________________" << endl << endl;
+    *messages << "___________________________________________________" << endl << endl;
 }
 
 void Assembler::printFLinkTable()
 {
     for(const auto& entry : sectionTable){
-        std::cout << "SECTION " << entry.second->name << " ";
-        std::cout << endl << "FLINK TABLE:" << endl << endl;
+        *messages << "SECTION " << entry.second->name << " ";
+        *messages << endl << "FLINK TABLE:" << endl << endl;
         
         for (const auto& row : entry.second->fLinkTable) {
-            std::cout << "Symbol Identifier: " << row->symbolIdentifier << endl;
-            std::cout << "Symbol Value: " << dec << row->symbolValue << endl;
+            *messages << "Symbol Identifier: " << symbolTable[row->symbol].name << endl;
+            *messages << "Symbol Value: " << dec << row->symbolValue << endl;
 
-            for (const auto& action : row->fLinkAction) {
-                std::cout << "  Action Address: " << dec << action.address << ", Operation: " << operationToString(action.operation) << ", ST8: " << (action.st8Relocation == true? "true":"false") << endl;
+            for (FLinkAction* action = row->firstAction; action != nullptr; action = action->next) {
+                *messages << "  Action Address: " << dec << action->address << ", Operation: " << operationToString(action->operation) << ", ST8: " << (action->st8Relocation == true? "true":"false") << endl;
             }
-            std::cout << "-----------------------------------" << endl;
+            *messages << "-----------------------------------" << endl;
         }
     }
-    std::cout << "___________________________________________________" << endl << endl;
+    *messages << "___________________________________________________" << endl << endl;
 
 }
 
@@ -1990,24 +1420,24 @@ void Assembler::printRelocationTables()
     for (const auto& pair: relocationTables) {
         int sectionId = pair.first;
         vector<RelocationTableRow*> rows = pair.second;
-        std::cout << "Section ID: " << sectionId << endl;
-        std::cout << "-------------------------------------------------------------" << endl;
-        std::cout << left 
+        *messages << "Section ID: " << sectionId << endl;
+        *messages << "-------------------------------------------------------------" << endl;
+        *messages << left 
              << setw(width_offset) << "Offset" 
              << setw(width_type) << "Type" 
              << setw(width_symbol) << "Symbol" 
              << setw(width_addend) << "Addend" << endl;
-        std::cout << "-------------------------------------------------------------" << endl;
+        *messages << "-------------------------------------------------------------" << endl;
 
         for (const auto& row : rows) {
-            std::cout << dec<< left 
+            *messages << dec<< left 
                  << setw(width_offset) << row->offset 
                  << setw(width_type) << to_string(row->type) 
                  << setw(width_symbol) << row->symbol 
                  << setw(width_addend) << row->addend << endl;
         }
 
-        std::cout << "-------------------------------------------------------------" << endl;
+        *messages << "-------------------------------------------------------------" << endl;
     }
 }
 
@@ -2035,10 +1465,16 @@ int Assembler::literal_to_int(string param)
     } else {
        base = 10; // decimal
     }
-    unsigned long check = std::stoul(param, nullptr, base);
+    // the scanner takes any number of digits
+    unsigned long long check = 0;
+    try{
+        check = std::stoull(param, nullptr, base);
+    } catch(const std::out_of_range&){
+        check = ULLONG_MAX;
+    }
     if(check >> 32 != 0){
-        std::cout << "Assembler: ERROR -> literal bigger than 32bits!";
-        exit(0);
+        *messages << "Assembler: ERROR -> literal " << param << " bigger than 32bits!" << endl;
+        throw AssemblerError();
     }
 
     number = static_cast<int>(check);
@@ -2049,6 +1485,8 @@ int Assembler::literal_to_int(string param)
 
 void Assembler::insert_word_into_machine_code(int value)
 {
+    reserve_literal_pool_range(WORD_SIZE);
+
     char firstByte = value & 0x000000FF;
     char secondByte = (value >> 8) & 0x000000FF;
     char thirdByte = (value >> 16) & 0x000000FF;
@@ -2080,6 +1518,36 @@ int Assembler::general_register_string_to_index(string param)
     return -1;
 }
 
+/**
+ * Called by the parser once per operand: registers and literals are decoded here, symbols
+ * are interned, the emitters switch on the kind.
+ */
+Operand Assembler::make_operand(OperandKind kind, const Token* reg, const Token* literal, const Token* symbol)
+{
+    Operand operand;
+    operand.kind = kind;
+    operand.reg = reg != NULL ? general_register_string_to_index(string(reg->text, reg->length)) : -1;
+    operand.literal = literal != NULL ? literal_to_int(string(literal->text, literal->length)) : 0;
+    operand.symbol = symbol != NULL ? intern_symbol(string(symbol->text, symbol->length)) : -1;
+
+    return operand;
+}
+
+int Assembler::intern_symbol(string name)
+{
+    auto it = symbolIds.find(name);
+    if(it != symbolIds.end()){
+        return it->second;
+    }
+
+    // new symbol, waits for its definition
+    int id = symbolTable.size();
+    symbolTable.push_back(SymbolTableRow(id, 0, 0, WFI, LOC, UND, name, false));
+    symbolIds[name] = id;
+
+    return id;
+}
+
 int Assembler::system_register_string_to_index(string param)
 {
     param.erase(0,1);
@@ -2091,28 +1559,461 @@ int Assembler::system_register_string_to_index(string param)
     } else if ( param == "cause"){
         return 2;
     } else {
-        std::cout << "Assembler: ERROR -> unknown system register " << param << endl;
-        exit(0);
+        *messages << "Assembler: ERROR -> unknown system register " << param << endl;
+        throw AssemblerError();
     }
 }
 
-void Assembler::push_to_flink(string param, int symbolValue, int address, Operation operation, bool st8Relocation)
+void Assembler::push_to_flink(int symbol, int symbolValue, int address, Operation operation, bool st8Relocation)
 {
     // Error
     if (currentSection == "0"){
-        std::cout << "assembler: ERROR -> pushing to flink attempted outside of section." << endl;  
-        exit(0);
+        *messages << "assembler: ERROR -> pushing to flink attempted outside of section." << endl;  
+        throw AssemblerError();
     }
 
     vector<FLinkRow*>& fLinkTable = sectionTable[currentSection]->fLinkTable;
-    unordered_map<string, FLinkRow*>& fLinkTableMap = sectionTable[currentSection]->fLinkTableMap;
-    if(fLinkTableMap.find(param) == fLinkTableMap.end()){
-        FLinkRow* f = new FLinkRow(param, symbolValue, address, operation, st8Relocation);
-        fLinkTable.push_back(f);
-        fLinkTableMap[param] = f;
+    unordered_map<int, FLinkRow*>& fLinkTableMap = sectionTable[currentSection]->fLinkTableMap;
+    FLinkRow* row;
+    auto it = fLinkTableMap.find(symbol);
+    if(it == fLinkTableMap.end()){
+        row = arena.create<FLinkRow>(symbol, symbolValue);
+        fLinkTable.push_back(row);
+        fLinkTableMap[symbol] = row;
+    }
+    else{
+        row = it->second;
+    }
+
+    // append
+    FLinkAction* action = arena.create<FLinkAction>(address, operation, st8Relocation);
+    if(row->lastAction == nullptr){
+        row->firstAction = action;
+    } else {
+        row->lastAction->next = action;
+    }
+    row->lastAction = action;
+}
+
+/**
+ * Evaluates a postfix .equ expression into a constant plus a number of times each section
+ * (for labels) or external symbol appears. False, with the symbol, if a symbol isn't defined yet.
+ */
+bool Assembler::evaluate_expression(vector<string>& expression, ExpressionValue& result, int& missing)
+{
+    vector<ExpressionValue> stack;
+
+    for(string token: expression){
+        if(token[0] <= 57 && token[0] >= 48){ // literal
+            ExpressionValue value;
+            value.constant = literal_to_int(token);
+            stack.push_back(value);
+            continue;
+        }
+
+        if(token == "u-"){
+            for(auto& term: stack.back().terms){
+                term.second = -term.second;
+            }
+            stack.back().constant = -(uint32_t)stack.back().constant;
+            continue;
+        }
+
+        if(token == "+" || token == "-" || token == "*" || token == "/" || token == "<<" || token == ">>"){
+            ExpressionValue right = stack.back();
+            stack.pop_back();
+            ExpressionValue& left = stack.back();
+
+            // constant * address: the address goes left, like address * constant
+            if(token == "*" && is_absolute(left) && !is_absolute(right)){
+                swap(left, right);
+            }
+
+            if(token == "+" || token == "-"){
+                int sign = token == "+" ? 1 : -1;
+                for(auto& term: right.terms){
+                    left.terms[term.first] += sign * term.second;
+                }
+                left.constant = (uint32_t)left.constant + sign * (uint32_t)right.constant;
+                continue;
+            }
+
+            // addresses can only be added, subtracted and multiplied by a constant
+            if(!is_absolute(right) || (!is_absolute(left) && token != "*")){
+                *messages << "Assembler: ERROR -> .equ operator " << token << " needs constant operands" << endl;
+                throw AssemblerError();
+            }
+
+            if(token == "*"){
+                for(auto& term: left.terms){
+                    term.second *= right.constant;
+                }
+                left.constant = (uint32_t)left.constant * (uint32_t)right.constant;
+            } else if(token == "/"){
+                if(right.constant == 0){
+                    *messages << "Assembler: ERROR -> .equ division by zero" << endl;
+                    throw AssemblerError();
+                }
+                // unsigned like the other operators (and no INT_MIN / -1 trap)
+                left.constant = (uint32_t)left.constant / (uint32_t)right.constant;
+            } else if(token == "<<"){
+                left.constant = (uint32_t)left.constant << (right.constant & 31);
+            } else {
+                left.constant = (uint32_t)left.constant >> (right.constant & 31);
+            }
+            continue;
+        }
+
+        // symbol
+        int id = intern_symbol(token);
+        SymbolTableRow& symbol = symbolTable[id];
+        ExpressionValue value;
+
+        if(symbol.type == WFI){
+            missing = id;
+            return false;
+        } else if(symbol.ndx == ABS){
+            value.constant = symbol.value;
+        } else if(symbol.ndx == EXT){
+            value.terms[id] = 1;
+        } else if(symbol.equ == true && equTable[id]->base != -1){
+            value.terms[equTable[id]->base] = 1;
+            value.constant = symbol.value;
+        } else {
+            value.terms[section_symbol(symbol.ndx)] = 1;
+            value.constant = symbol.value;
+        }
+        stack.push_back(value);
+    }
+
+    result = stack.back();
+    return true;
+}
+
+bool Assembler::is_absolute(ExpressionValue& value)
+{
+    for(auto& term: value.terms){
+        if(term.second != 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+// symbol of the section with this ndx
+int Assembler::section_symbol(int ndx)
+{
+    return sectionSymbols[ndx];
+}
+
+/**
+ * What an .equ symbol can be: a constant (ABS, never relocated), an address in a section of
+ * this file (like a label), or the address of an external symbol plus a constant (relocated
+ * against that symbol).
+ */
+void Assembler::resolve_equ(int id)
+{
+    EquDefinition* definition = equTable[id];
+    ExpressionValue value;
+    int missing;
+
+    if(!evaluate_expression(definition->expression, value, missing)){
+        if(missing == id){
+            *messages << "Assembler: ERROR -> .equ " << symbolTable[id].name << " depends on itself" << endl;
+            throw AssemblerError();
+        }
+        // try again when the symbol is defined
+        equDependents[missing].push_back(id);
+        return;
+    }
+
+    int address = -1;
+    for(auto& term: value.terms){
+        if(term.second == 0){
+            continue;
+        }
+        if(term.second != 1 || address != -1){
+            *messages << "Assembler: ERROR -> .equ " << symbolTable[id].name << " is neither a constant nor one address plus a constant" << endl;
+            throw AssemblerError();
+        }
+        address = term.first;
+    }
+
+    SymbolTableRow& symbol = symbolTable[id];
+    symbol.type = NOTYP;
+    symbol.value = value.constant;
+
+    if(address == -1){
+        symbol.ndx = ABS;
+    } else if(symbolTable[address].type == SCTN){
+        symbol.ndx = symbolTable[address].ndx;
+        if(address == sectionTable[currentSection]->symbol){
+            resolve_branches(id);
+        }
+    } else {
+        symbol.ndx = UND;
+        definition->base = address;
+    }
+
+    symbol_defined(id);
+}
+
+// resolves the .equ symbols that were waiting for this one
+void Assembler::symbol_defined(int id)
+{
+    if(equDependents.find(id) == equDependents.end()){
+        return;
+    }
+
+    vector<int> dependents = equDependents[id];
+    equDependents.erase(id);
+
+    for(int dependent: dependents){
+        resolve_equ(dependent);
+    }
+}
+
+Assembler::LiteralPoolEntry Assembler::literal_pool_constant(int value)
+{
+    return LiteralPoolEntry(-1, value);
+}
+
+Assembler::LiteralPoolEntry Assembler::literal_pool_symbol(int symbol)
+{
+    if(symbolTable[symbol].ndx == ABS){
+        return literal_pool_constant(symbolTable[symbol].value);
+    }
+
+    return LiteralPoolEntry(symbol, 0);
+}
+
+/**
+ * Target of call, jmp and the branches: a literal or a symbol (used as the address, no $).
+ */
+Assembler::LiteralPoolEntry Assembler::branch_target(Operand target)
+{
+    switch(target.kind){
+        case OPERAND_MEMORY_LITERAL:
+            return literal_pool_constant(target.literal);
+        case OPERAND_MEMORY_SYMBOL:
+            return literal_pool_symbol(target.symbol);
+        default:
+            *messages << "Assembler: ERROR -> Unknown operand type for jump instructions: " << target.kind << endl;
+            throw AssemblerError();
+    };
+}
+
+/**
+ * Value known now that fits the D field: the instruction can use it directly, with r0
+ * (always 0) as the base register.
+ */
+bool Assembler::is_small_constant(LiteralPoolEntry entry)
+{
+    return entry.symbol == -1 && entry.value >= DISPLACEMENT_MIN && entry.value <= DISPLACEMENT_MAX;
+}
+
+/**
+ * Instruction with a pc relative memory operand (A = pc, D = 0) reading a literal pool entry.
+ * D is filled in when the pool is placed.
+ */
+void Assembler::insert_literal_pool_instruction(int insCode, LiteralPoolEntry entry)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+
+    // if the pool has to be placed first, the entry goes into the next one
+    reserve_literal_pool_range(2 * WORD_SIZE);
+
+    insert_word_into_machine_code(insCode);
+    add_literal_pool_reference(section->data.size() - WORD_SIZE, entry);
+
+    locationCounter += WORD_SIZE;
+}
+
+void Assembler::add_literal_pool_reference(uint32_t address, LiteralPoolEntry entry)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+
+    unordered_map<int, int>& entries = entry.symbol == -1 ? section->literalPoolConstants : section->literalPoolSymbols;
+    int key = entry.symbol == -1 ? entry.value : entry.symbol;
+    if(entries.find(key) == entries.end()){
+        entries[key] = section->literalPool.size();
+        section->literalPool.push_back(entry);
+    }
+
+    // kept sorted by address, a branch that grows can be older than the last reference
+    vector<LiteralPoolReference>& references = section->literalPoolReferences;
+    auto position = references.end();
+    while(position != references.begin() && (position - 1)->address > address){
+        position --;
+    }
+    references.insert(position, LiteralPoolReference(address, entries[key]));
+}
+
+/**
+ * Jump, call or branch. A target in this section within reach of D gets the pc relative
+ * (short) form, anything else reads the target address from the literal pool (long form,
+ * the same size). The target of a forward branch isn't known yet: the branch waits in
+ * short form for its label and grows if the label is out of reach, isn't in this section
+ * or the pool has to be placed first.
+ */
+void Assembler::insert_branch_instruction(int shortInsCode, int longInsCode, LiteralPoolEntry target)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+
+    if(target.symbol == -1){
+        if(is_small_constant(target)){
+            // absolute target, A = r0
+            insert_word_into_machine_code((shortInsCode & ~(0xF << 20)) | (target.value & 0xFFF));
+            locationCounter += WORD_SIZE;
+        }
+        else{
+            insert_literal_pool_instruction(longInsCode, target);
+        }
+        return;
+    }
+
+    SymbolTableRow& symbol = symbolTable[target.symbol];
+
+    // a waiting branch may need a pool entry, room for it is reserved like for a reference
+    reserve_literal_pool_range(2 * WORD_SIZE);
+
+    if(symbol.type == WFI){
+        insert_word_into_machine_code(shortInsCode);
+        section->branches.push_back(Branch(section->data.size() - WORD_SIZE, longInsCode, target.symbol));
+        locationCounter += WORD_SIZE;
+        return;
+    }
+
+    int displacement = symbol.value - (section->data.size() + WORD_SIZE);
+
+    if(symbol.ndx == symbolTable[section->symbol].ndx && displacement >= DISPLACEMENT_MIN && displacement <= DISPLACEMENT_MAX){
+        insert_word_into_machine_code(shortInsCode | (displacement & 0xFFF));
+        locationCounter += WORD_SIZE;
     }
     else{
-        fLinkTableMap[param]->fLinkAction.push_back(FLinkAction(address, operation, st8Relocation));
+        insert_literal_pool_instruction(longInsCode, target);
+    }
+}
+
+/**
+ * A label of the current section was defined: branches waiting for it get their distance,
+ * or grow if it doesn't fit.
+ */
+void Assembler::resolve_branches(int label)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+    vector<Branch> waiting;
+
+    for(Branch branch: section->branches){
+        if(branch.symbol != label){
+            waiting.push_back(branch);
+            continue;
+        }
+
+        int displacement = symbolTable[label].value - (branch.address + WORD_SIZE);
+        if(displacement >= DISPLACEMENT_MIN && displacement <= DISPLACEMENT_MAX){
+            section->data[branch.address] |= displacement & 0xFF;
+            section->data[branch.address + 1] |= (displacement >> 8) & 0x0F;
+        }
+        else{
+            grow_branch(branch);
+        }
+    }
+
+    section->branches = waiting;
+}
+
+void Assembler::grow_branch(Branch branch)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+
+    for(int i = 0; i < WORD_SIZE; i ++){
+        section->data[branch.address + i] = (branch.longInsCode >> (i * 8)) & 0xFF;
+    }
+    add_literal_pool_reference(branch.address, LiteralPoolEntry(branch.symbol, 0));
+}
+
+/**
+ * Called before bytes are added to the current section. If the pool placed after them (jumped
+ * over, with one more entry) could no longer be reached from the oldest reference, the pool is
+ * placed now.
+ */
+void Assembler::reserve_literal_pool_range(int bytes)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+
+    if(section->literalPoolReferences.empty() && section->branches.empty()){
+        return;
+    }
+
+    // every waiting branch may still need an entry
+    int entries = section->literalPool.size() + section->branches.size();
+    int lastEntry = section->data.size() + bytes + WORD_SIZE + entries * WORD_SIZE;
+
+    uint32_t firstReference = UINT32_MAX;
+    if(!section->literalPoolReferences.empty()){
+        firstReference = section->literalPoolReferences.front().address;
+    }
+    if(!section->branches.empty()){
+        firstReference = min(firstReference, section->branches.front().address);
+    }
+    int firstReferencePc = firstReference + WORD_SIZE;
+
+    if(lastEntry - firstReferencePc > DISPLACEMENT_MAX){
+        place_literal_pool(true);
+    }
+}
+
+void Assembler::place_literal_pool(bool jumpOver)
+{
+    SectionDefinition* section = sectionTable[currentSection];
+
+    // targets of branches still waiting are after the pool or not in this section
+    for(Branch branch: section->branches){
+        grow_branch(branch);
+    }
+    section->branches.clear();
+
+    if(section->literalPool.empty()){
+        return;
+    }
+
+    vector<LiteralPoolEntry> pool = section->literalPool;
+    vector<LiteralPoolReference> references = section->literalPoolReferences;
+
+    section->literalPool.clear();
+    section->literalPoolSymbols.clear();
+    section->literalPoolConstants.clear();
+    section->literalPoolReferences.clear();
+
+    if(jumpOver){
+        // pc<=gpr[A]+D;
+        // A = pc, D = pool size
+        insert_word_into_machine_code(0x30F00000 | (pool.size() * WORD_SIZE));
+        locationCounter += WORD_SIZE;
+    }
+
+    uint32_t poolAddress = section->data.size();
+
+    for(LiteralPoolEntry entry: pool){
+        if(entry.symbol == -1){
+            insert_word_into_machine_code(entry.value);
+        }
+        else{
+            // add to flink.
+            push_to_flink(entry.symbol, -1, section->data.size(), PLUS, false);
+            // Insert zeroes into machine code;
+            insert_word_into_machine_code(0);
+        }
+    }
+    locationCounter += pool.size() * WORD_SIZE;
+
+    // D = entry - pc, pc points to the instruction after the reference
+    for(LiteralPoolReference reference: references){
+        int displacement = poolAddress + reference.entry * WORD_SIZE - (reference.address + WORD_SIZE);
+
+        section->data[reference.address] |= displacement & 0xFF;
+        section->data[reference.address + 1] |= (displacement >> 8) & 0x0F;
     }
 }
 
@@ -2137,7 +2038,7 @@ void Assembler::print_elf(string fileName)
     // Check if the file was opened successfully
     if (!file) {
         std::cerr << "Assembler: Error -> Could not open the elf file while printing it onto the console!" << std::endl;
-        exit(0);
+        throw AssemblerError();
     }
 
     // Read 8 bytes at a time and print in the desired format
@@ -2150,28 +2051,28 @@ void Assembler::print_elf(string fileName)
         // Print 4 bytes in hexadecimal
         for (std::size_t i = 0; i < 4; ++i) {
             if (i < bytesRead) {
-                std::cout << std::hex << std::setw(2) << std::setfill('0') << (static_cast<unsigned int>(static_cast<unsigned char>(buffer[i])));
-                std::cout << " ";
+                *messages << std::hex << std::setw(2) << std::setfill('0') << (static_cast<unsigned int>(static_cast<unsigned char>(buffer[i])));
+                *messages << " ";
             }
             else {
-                std::cout << "  ";  // Padding if fewer than 4 bytes are read
+                *messages << "  ";  // Padding if fewer than 4 bytes are read
             }
         }
 
-        std::cout << "   ";  // Space separator
+        *messages << "   ";  // Space separator
 
         // Print next 4 bytes in hexadecimal
         for (std::size_t i = 4; i < chunkSize; ++i) {
             if (i < bytesRead) {
-                std::cout << std::hex << std::setw(2) << std::setfill('0') << (static_cast<unsigned int>(static_cast<unsigned char>(buffer[i])));
-                std::cout << " ";
+                *messages << std::hex << std::setw(2) << std::setfill('0') << (static_cast<unsigned int>(static_cast<unsigned char>(buffer[i])));
+                *messages << " ";
             }
             else {
-                std::cout << "  ";  // Padding if fewer than 4 bytes are read
+                *messages << "  ";  // Padding if fewer than 4 bytes are read
             }
         }
 
-        std::cout << std::endl;
+        *messages << std::endl;
     }
 
     // Close the file
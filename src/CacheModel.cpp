@@ -0,0 +1,122 @@
+#include "./../inc/CacheModel.h"
+#include <algorithm>
+#include <map>
+
+#define CACHE_REPORT_TOP_PCS 10
+
+CacheModel::CacheModel(std::string name, uint32_t size, uint32_t associativity, uint32_t lineSize):
+    name(name), size(size), associativity(associativity), lineSize(lineSize)
+{
+    numberOfSets = size / (associativity * lineSize);
+    offsetBits = log2(lineSize);
+    setBits = log2(numberOfSets);
+    useCounter = 0;
+
+    CacheLine empty;
+    empty.valid = false;
+    empty.tag = 0;
+    empty.lastUse = 0;
+    lines.assign(numberOfSets * associativity, empty);
+}
+
+/**
+ * Simulates one access. Returns true on hit.
+ */
+bool CacheModel::access(uint32_t address, uint32_t pc)
+{
+    uint32_t set = (address >> offsetBits) & (numberOfSets - 1);
+    uint32_t tag = address >> (offsetBits + setBits);
+
+    CacheLine* ways = &lines[set * associativity];
+    CacheLine* victim = &ways[0];
+
+    useCounter++;
+
+    for(uint32_t i = 0; i < associativity; i ++){
+        if(ways[i].valid && ways[i].tag == tag){
+            ways[i].lastUse = useCounter;
+            total.hits++;
+            perPc[pc].hits++;
+            return true;
+        }
+
+        // invalid lines are used first, then the least recently used one.
+        if(!ways[i].valid){
+            if(victim->valid){
+                victim = &ways[i];
+            }
+        } else if(victim->valid && ways[i].lastUse < victim->lastUse){
+            victim = &ways[i];
+        }
+    }
+
+    victim->valid = true;
+    victim->tag = tag;
+    victim->lastUse = useCounter;
+
+    total.misses++;
+    perPc[pc].misses++;
+    return false;
+}
+
+void CacheModel::report(std::ostream& out, std::function<std::string(uint32_t)> symbolize)
+{
+    uint64_t accesses = total.hits + total.misses;
+
+    out << "-----------------------------------------------------------------" << std::endl;
+    out << name << ": " << std::dec << size << "B, " << associativity << "-way, "
+        << lineSize << "B lines" << std::endl;
+    out << "accesses=" << accesses << " hits=" << total.hits << " misses=" << total.misses;
+    if(accesses != 0){
+        out << " miss rate=" << std::fixed << std::setprecision(2) << (100.0 * total.misses / accesses) << "%";
+    }
+    out << std::endl;
+
+    // worst PCs
+    std::vector<std::pair<uint32_t, CacheCounter>> pcs(perPc.begin(), perPc.end());
+    std::sort(pcs.begin(), pcs.end(), [](const std::pair<uint32_t, CacheCounter>& a, const std::pair<uint32_t, CacheCounter>& b){
+        return a.second.misses > b.second.misses || (a.second.misses == b.second.misses && a.first < b.first);
+    });
+
+    out << "misses per pc:" << std::endl;
+    for(size_t i = 0; i < pcs.size() && i < CACHE_REPORT_TOP_PCS; i ++){
+        out << "  0x" << std::hex << std::setw(8) << std::setfill('0') << pcs[i].first
+            << std::dec << std::setfill(' ')
+            << " hits=" << pcs[i].second.hits << " misses=" << pcs[i].second.misses
+            << " " << symbolize(pcs[i].first) << std::endl;
+    }
+
+    // per symbol
+    std::map<std::string, CacheCounter> perSymbol;
+    for(const auto& pair: perPc){
+        CacheCounter& c = perSymbol[symbolize(pair.first)];
+        c.hits += pair.second.hits;
+        c.misses += pair.second.misses;
+    }
+
+    out << "per symbol:" << std::endl;
+    for(const auto& pair: perSymbol){
+        out << "  " << std::left << std::setw(24) << pair.first << std::right
+            << " hits=" << pair.second.hits << " misses=" << pair.second.misses << std::endl;
+    }
+}
+
+bool CacheModel::is_valid_config(uint32_t size, uint32_t associativity, uint32_t lineSize)
+{
+    auto powerOfTwo = [](uint32_t v){ return v != 0 && (v & (v - 1)) == 0; };
+
+    if(!powerOfTwo(size) || !powerOfTwo(associativity) || !powerOfTwo(lineSize) || lineSize < 4){
+        return false;
+    }
+
+    return size >= associativity * lineSize;
+}
+
+uint32_t CacheModel::log2(uint32_t value)
+{
+    uint32_t bits = 0;
+    while((1u << bits) < value){
+        bits++;
+    }
+    return bits;
+}
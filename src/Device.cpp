@@ -0,0 +1,66 @@
+#include "./../inc/Device.h"
+
+void DeviceScheduler::resume_after(uint64_t ticks, std::coroutine_handle<> handle)
+{
+    uint64_t startGeneration = generation;
+
+    schedule(ticks, [this, handle, startGeneration]{
+        if(generation == startGeneration){
+            handle.resume();
+        }
+    });
+}
+
+/**
+ * One device waits for a register at a time. With a timeout the device is resumed without
+ * a value unless the write comes first, a timeout of a wait that already ended is ignored.
+ */
+void DeviceScheduler::wait_for_write(uint32_t address, uint64_t timeout, std::coroutine_handle<> handle, RegisterWrite* result)
+{
+    uint64_t id = nextWaitId++;
+    waiters[address] = { handle, result, id };
+
+    if(timeout == NO_TIMEOUT){
+        return;
+    }
+
+    uint64_t startGeneration = generation;
+    schedule(timeout, [this, address, id, startGeneration]{
+        auto it = waiters.find(address);
+        if(generation != startGeneration || it == waiters.end() || it->second.id != id){
+            return;
+        }
+
+        std::coroutine_handle<> waiting = it->second.handle;
+        waiters.erase(it);
+        waiting.resume();
+    });
+}
+
+bool DeviceScheduler::resume_waiter(uint32_t address, uint32_t value)
+{
+    auto it = waiters.find(address);
+    if(it == waiters.end()){
+        return false;
+    }
+
+    // the device may wait for the same register again before resume returns
+    Waiter waiter = it->second;
+    waiters.erase(it);
+
+    waiter.result->written = true;
+    waiter.result->value = value;
+    waiter.handle.resume();
+
+    return true;
+}
+
+/**
+ * Destroys every device, wherever it is suspended. The devices have to be started again.
+ */
+void DeviceScheduler::reset()
+{
+    generation ++;
+    waiters.clear();
+    tasks.clear();
+}
@@ -1,4 +1,16 @@
 #include "./../inc/Emulator.h"
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#include <cerrno>
+
+TranslatedCode* Emulator::translatedCodeRegistry = nullptr;
+
+std::mutex Emulator::sharedImagesMutex;
+std::map<std::string, std::weak_ptr<Emulator::SharedImage>> Emulator::sharedImages;
+
+volatile uint32_t* Emulator::sampledPc = nullptr;
+uint32_t* Emulator::samples = nullptr;
+std::atomic<uint32_t> Emulator::numberOfSamples(0);
 
 void Emulator::powerOn()
 {
@@ -8,6 +20,33 @@ void Emulator::powerOn()
     // init memory
     init_memory();
 
+    // guest symbols, if the linker generated them
+    init_symbol_map();
+
+    // host file access for the guest, if a sandbox was given
+    init_semihosting();
+
+    // block device, if an image was given
+    init_block_device();
+
+    // device models
+    start_devices();
+
+    // instruction trace
+    init_trace();
+
+    // memory statistics: one byte per page of the address space
+    if(options.memoryStats){
+        pageUse.assign(1u << (32 - PAGE_BITS), 0);
+        sp_seen(gprx[SP_INDEX]);
+    }
+
+    // translated code, if it was linked in
+    init_translated_code();
+
+    // perf map and pc sampling
+    init_perf();
+
     // run
     run();
 }
@@ -32,10 +71,7 @@ void Emulator::init_hardware()
  
     // other registers.
     for(int i = 0; i < 256; i += 4){
-        memory[MEMORY_MAPPED_REGISTER_START_ADDRESS + i] = 0;
-        memory[MEMORY_MAPPED_REGISTER_START_ADDRESS + i + 1] = 0;
-        memory[MEMORY_MAPPED_REGISTER_START_ADDRESS + i + 2] = 0;
-        memory[MEMORY_MAPPED_REGISTER_START_ADDRESS + i + 3] = 0;
+        memory.write_word(MEMORY_MAPPED_REGISTER_START_ADDRESS + i, 0);
     }
 
     
@@ -43,13 +79,46 @@ void Emulator::init_hardware()
 
 void Emulator::init_memory()
 {
-    std::ifstream file(inputFileName);
+    image = load_shared_image(inputFileName);
 
-    if (!file.is_open()) {
+    if (image == nullptr) {
         std::cerr << "Emulator: ERROR -> Could not open file " << inputFileName << "\n";
         my_exit();
     }
 
+    for(size_t i = 0; i < image->pages.size(); i ++){
+        memory.map_shared(image->pages[i].first, image->pages[i].second.get(), i);
+    }
+}
+
+/**
+ * Images are parsed once per process: every instance that loads the same (unchanged) file
+ * maps the same read-only pages and uses the same predecoded instructions for them. The
+ * image goes away with the last instance that uses it.
+ */
+std::shared_ptr<Emulator::SharedImage> Emulator::load_shared_image(std::string fileName)
+{
+    struct stat st;
+    if(stat(fileName.c_str(), &st) != 0){
+        return nullptr;
+    }
+    std::string key = fileName + ":" + std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" + std::to_string(st.st_mtime);
+
+    std::lock_guard<std::mutex> lock(sharedImagesMutex);
+
+    std::shared_ptr<SharedImage> shared = sharedImages[key].lock();
+    if(shared != nullptr){
+        return shared;
+    }
+
+    std::ifstream file(fileName);
+
+    if (!file.is_open()) {
+        return nullptr;
+    }
+
+    std::map<uint32_t, std::unique_ptr<unsigned char[]>> pages;
+
     std::string line;
     while (std::getline(file, line)) {
         std::istringstream iss(line);
@@ -64,27 +133,245 @@ void Emulator::init_memory()
             // Convert hex string to unsigned char
             unsigned char value = static_cast<unsigned char>(std::stoul(hexValue, nullptr, 16));
 
-            // Insert key-value pair into the map
-            memory[key] = value;
+            std::unique_ptr<unsigned char[]>& page = pages[key & ~(PAGE_SIZE - 1)];
+            if(page == nullptr){
+                page.reset(new unsigned char[PAGE_SIZE]());
+            }
+            page[key & (PAGE_SIZE - 1)] = value;
         }
     }
 
     file.close();
 
-    // for(const auto& pair: memory){
-    //     std::cout << pair.first << " : " << std::hex << (int)(pair.second) << std::endl;
-    // }
+    shared = std::make_shared<SharedImage>();
+    for(auto& pair: pages){
+        std::vector<Instruction> decoded(PAGE_SIZE / WORD_SIZE);
+        for(uint32_t i = 0; i < PAGE_SIZE / WORD_SIZE; i ++){
+            uint32_t word;
+            memcpy(&word, pair.second.get() + i * WORD_SIZE, WORD_SIZE);
+            decoded[i] = decode(word);
+        }
+
+        shared->decoded.push_back(std::move(decoded));
+        shared->pages.push_back({pair.first, std::move(pair.second)});
+    }
+
+    sharedImages[key] = shared;
+    return shared;
+}
+
+void Emulator::init_symbol_map()
+{
+    if(options.symbolMapFile.empty()){
+        return;
+    }
+
+    std::ifstream file(options.symbolMapFile);
+
+    if (!file.is_open()) {
+        std::cerr << "Emulator: ERROR -> Could not open symbol map " << options.symbolMapFile << "\n";
+        my_exit();
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        uint32_t address;
+        uint32_t size;
+        std::string type;
+        std::string name;
+
+        if (iss >> std::hex >> address >> size >> type >> name) {
+            // symbols take precedence over the section they are defined in
+            if(type == "NOTYP" || symbolMap.find(address) == symbolMap.end()){
+                symbolMap[address] = name;
+            }
+        }
+    }
+
+    file.close();
+}
+
+/**
+ * Returns the name of the closest symbol at or below the address.
+ */
+std::string Emulator::symbolize(uint32_t address)
+{
+    auto it = symbolMap.upper_bound(address);
+
+    if(it == symbolMap.begin()){
+        return "?";
+    }
+    --it;
+
+    return it->second;
 }
 
 void Emulator::run()
 {
-    terminal = std::thread(&Emulator::terminal_thread_function, this);
+    init_io();
+
+    if(options.lockstep){
+        run_lockstep();
+    }
+
+    while(true){
+        // translated code runs until it reaches code it can not handle
+        if(translatedCode != nullptr){
+            translatedCode->run(*this);
+        }
+
+        step();
+    }
+}
+
+/**
+ * Executes one instruction. Returns true when the basic block ended with it.
+ */
+bool Emulator::step()
+{
+    uint32_t pc = gprx[PC_INDEX];
+
+    currentInstruction = options.predecode ? get_predecoded_instruction() : get_instruction();
+
+    if(trace != nullptr){
+        trace->instruction(currentInstructionAddress, currentInstruction.fullInstruction);
+    }
+
+    executingInstruction = true;
+    decode_and_execute(currentInstruction);
+    executingInstruction = false;
+
+    page_used(pc, PAGE_FETCHED);
+    sp_seen(gprx[SP_INDEX]);
+
+    if(++virtualClock >= nextEventTime){
+        run_scheduled_events();
+    }
+
+    // basic block ends when the instruction did not fall through to the next one.
+    // Only then (and only if a device raised something) are interrupts considered.
+    if(gprx[PC_INDEX] != pc + WORD_SIZE){
+        if(interruptController.has_pending()){
+            interrupt_check();
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Runs the predecode engine here and the reference interpreter on a second instance, 
+ * one basic block at a time. The reference has no devices: what the devices write into
+ * memory is replayed into it at the same virtual time and the interrupts taken here are 
+ * entered there at the end of the same block. Stops at the first difference in registers
+ * or in memory written during the block.
+ */
+void Emulator::run_lockstep()
+{
+    EmulatorOptions referenceOptions;
+    referenceOptions.lockstep = true;
+
+    Emulator* reference = new Emulator(inputFileName, referenceOptions);
+    reference->devicesEnabled = false;
+    reference->init_hardware();
+    reference->init_memory();
+
+    options.predecode = true;
+
     while(true){
-        terminal_check();
-        currentInstruction = get_instruction();
-        //std::cout << gprx_get(1) << std::endl;
-        decode_and_execute(currentInstruction);
+        uint32_t blockAddress = gprx[PC_INDEX];
+
+        writtenAddresses.clear();
+        deviceWrites.clear();
+        takenInterrupt = 0;
+        reference->writtenAddresses.clear();
+
+        while(!step() && !halted);
+
+        for(const DeviceWrite& write: deviceWrites){
+            uint64_t delay = write.time > reference->virtualClock ? write.time - reference->virtualClock : 0;
+            reference->schedule(delay, [reference, write]{
+                for(uint32_t i = 0; i < write.data.size(); i ++){
+                    reference->memory.write_byte(write.address + i, write.data[i]);
+                }
+            });
+        }
+
+        while(!reference->step() && !reference->halted);
+
+        if(takenInterrupt != 0){
+            reference->interrupt_enter(takenInterrupt);
+        }
+
+        lockstep_compare(reference, blockAddress);
+
+        if(halted){
+            delete reference;
+            power_off();
+        }
+    }
+}
+
+void Emulator::lockstep_compare(Emulator* reference, uint32_t blockAddress)
+{
+    const char* csrNames[] = { "status", "handler", "cause" };
+    std::stringstream ss;
+    ss << std::hex << std::setfill('0');
+
+    if(halted != reference->halted){
+        ss << "    halt: reference " << reference->halted << " optimised " << halted << "\n";
+    }
+
+    for(int i = 0; i < 16; i ++){
+        if(gprx[i] != reference->gprx[i]){
+            ss << "    r" << std::dec << i << std::hex << ": reference 0x" << std::setw(8) << reference->gprx[i] 
+                << " optimised 0x" << std::setw(8) << gprx[i] << "\n";
+        }
+    }
+
+    for(int i = 0; i < 3; i ++){
+        if(csr[i] != reference->csr[i]){
+            ss << "    " << csrNames[i] << ": reference 0x" << std::setw(8) << reference->csr[i] 
+                << " optimised 0x" << std::setw(8) << csr[i] << "\n";
+        }
+    }
+
+    std::vector<uint32_t> addresses = writtenAddresses;
+    addresses.insert(addresses.end(), reference->writtenAddresses.begin(), reference->writtenAddresses.end());
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+    for(uint32_t address: addresses){
+        uint32_t value = 0;
+        uint32_t referenceValue = 0;
+        bool present = memory_peek_word(address, value);
+        bool referencePresent = reference->memory_peek_word(address, referenceValue);
+
+        if(present != referencePresent || value != referenceValue){
+            ss << "    mem32[0x" << std::setw(8) << address << "]: reference 0x" << std::setw(8) << referenceValue 
+                << " optimised 0x" << std::setw(8) << value << "\n";
+        }
+    }
+
+    if(ss.str().empty()){
+        return;
+    }
+
+    std::stringstream message;
+    message << std::hex << std::setfill('0') 
+        << "Emulator: ERROR -> lockstep divergence in block 0x" << std::setw(8) << blockAddress 
+        << " at pc 0x" << std::setw(8) << currentInstructionAddress 
+        << " instruction 0x" << std::setw(8) << (uint32_t)currentInstruction.fullInstruction;
+    if(reference->currentInstructionAddress != currentInstructionAddress 
+        || reference->currentInstruction.fullInstruction != currentInstruction.fullInstruction){
+        message << " (reference pc 0x" << std::setw(8) << reference->currentInstructionAddress
+            << " instruction 0x" << std::setw(8) << (uint32_t)reference->currentInstruction.fullInstruction << ")";
     }
+    message << "\n" << ss.str();
+
+    error_print_and_exit(message.str());
 }
 
 void Emulator::decode_and_execute(Instruction instruction)
@@ -109,22 +396,8 @@ void Emulator::decode_and_execute(Instruction instruction)
             if(instruction.mod == 0 && instruction.regA == 0
                 && instruction.regB == 0 && instruction.regC == 0 && instruction.disp == 0)
             {
-                // push status
-                gprx_set(SP_INDEX, gprx_get(SP_INDEX) - 4);
-                memory_set_word(gprx_get(SP_INDEX), gprx_get(STATUS_REG_INDEX));
-
-                // push pc
-                gprx_set(SP_INDEX, gprx_get(SP_INDEX) - 4);
-                memory_set_word(gprx_get(SP_INDEX), gprx_get(PC_INDEX));
-
-                // cause <= 4
-                csr_set(CAUSE_REG_INDEX, 4);
-
-                // status<=status&(~0x1);
-                csr_set(STATUS_REG_INDEX, csr_get(STATUS_REG_INDEX) & (~0x1));
-                
-                // call interruption, but it does nothing since this is a software interrupt.
-                interruption();
+                // software interrupt is synchronous and can not be masked.
+                interrupt_enter(CAUSE_SOFTWARE);
             }
             else{
                 csr_set(CAUSE_REG_INDEX, 1);
@@ -163,6 +436,7 @@ void Emulator::decode_and_execute(Instruction instruction)
                 csr_set(CAUSE_REG_INDEX, 1);
                 interruption();
             }
+            fuzz_edge(gprx[PC_INDEX]);
             break;
         case 0b0011: // Instrukcija skoka
             if(instruction.mod == 0b0000){
@@ -206,6 +480,8 @@ void Emulator::decode_and_execute(Instruction instruction)
                 csr_set(CAUSE_REG_INDEX, 1);
                 interruption();
             }
+            // taken or not, both are edges
+            fuzz_edge(gprx[PC_INDEX]);
             break;
         case 0b0100: // Instrukcija atomične zamene vrednosti
             if(instruction.mod != 0 || instruction.regA != 0 || instruction.disp != 0){
@@ -324,6 +600,9 @@ void Emulator::decode_and_execute(Instruction instruction)
             } else if(instruction.mod == 0b0010){ 
                 //  gpr[A]<=mem32[gpr[B]+gpr[C]+D];
                 //std::cout << "E E " << instruction.regB << " " << instruction.regC << " " << instruction.disp << std::endl;
+                if(instruction.regA == PC_INDEX){
+                    interrupt_return(gprx_get(instruction.regB) + gprx_get(instruction.regC) + instruction.disp);
+                }
                 gprx_set(
                     instruction.regA,
                     memory_get_word(
@@ -332,6 +611,9 @@ void Emulator::decode_and_execute(Instruction instruction)
                 );
             } else if(instruction.mod == 0b0011){
                 // gpr[A]<=mem32[gpr[B]]; gpr[B]<=gpr[B]+D;
+                if(instruction.regA == PC_INDEX){
+                    interrupt_return(gprx_get(instruction.regB));
+                }
                 gprx_set(
                     instruction.regA,
                     memory_get_word(gprx_get(instruction.regB))
@@ -373,13 +655,38 @@ void Emulator::decode_and_execute(Instruction instruction)
 
 void Emulator::halt()
 {
+    // in lockstep both engines finish the block first, a fuzzed input just ends
+    if(options.lockstep || fuzzing){
+        halted = true;
+        return;
+    }
+
+    power_off();
+}
+
+void Emulator::power_off()
+{
+    if(trace != nullptr){
+        trace->stop();
+    }
+
+    // the guest output comes before the end state
+    stop_io();
+
     print_end_state();
+    print_statistics();
     my_exit();
 }
 
 void Emulator::error_print_and_exit(std::string errorMessage)
 {
     std::cout << errorMessage << std::endl;
+
+    // a crash: the fuzzer keeps the input that got the guest here
+    if(fuzzing){
+        abort();
+    }
+
     my_exit();
 }
 
@@ -467,161 +774,1159 @@ uint32_t Emulator::status_bit_get(uint32_t bitIndex)
 
 void Emulator::memory_set_word(uint32_t address, uint32_t value)
 {
-    unsigned char byte0 = value;
-    unsigned char byte1 = (value >> 8) & 0x000000FF;
-    unsigned char byte2 = (value >> 16) & 0x000000FF;
-    unsigned char byte3 = (value >> 24) & 0x000000FF;
+#ifdef CACHE_MODEL
+    // memory mapped registers are not cached
+    if(address < MEMORY_MAPPED_REGISTER_START_ADDRESS){
+        dataCache->access(address, currentInstructionAddress);
+    }
+#endif
+
+    if(fuzzing){
+        undo_log_record(address, WORD_SIZE);
+    }
+
+    if(trace != nullptr){
+        trace->memory_write(address);
+    }
+
+    page_used(address, PAGE_WRITTEN);
+    memory.write_word(address, value);
 
-    memory[address] = byte0;
-    memory[address + 1] = byte1;
-    memory[address + 2] = byte2;
-    memory[address + 3] = byte3;
+    if(address >= MEMORY_MAPPED_REGISTER_START_ADDRESS){
+        mmio_write(address, value);
+    }
+
+    if(options.lockstep){
+        writtenAddresses.push_back(address);
+    }
+
+    // self modifying code
+    invalidate_code(address, WORD_SIZE);
 }
 uint32_t Emulator::memory_get_word(uint32_t address)
 {
-    unsigned char byte0 = memory[address];
-    unsigned char byte1 = memory[address + 1];
-    unsigned char byte2 = memory[address + 2];
-    unsigned char byte3 = memory[address + 3];
-
-    int retValue = 0;
+#ifdef CACHE_MODEL
+    // memory mapped registers are not cached
+    if(address < MEMORY_MAPPED_REGISTER_START_ADDRESS){
+        dataCache->access(address, currentInstructionAddress);
+    }
+#endif
 
-    retValue |= (int)byte0;
-    retValue |= ( (int)byte1 << 8 );
-    retValue |= ( (int)byte2 << 16 );
-    retValue |= ( (int)byte3 << 24 );
+    if(trace != nullptr){
+        trace->memory_read(address);
+    }
 
-    return retValue;
+    page_used(address, PAGE_READ);
+    return memory.read_word(address);
 }
 
-void Emulator::interruption()
+/**
+ * Copies guest memory into a host buffer. The range must not reach the memory mapped registers.
+ */
+bool Emulator::memory_read_block(uint32_t address, unsigned char* buffer, uint32_t length)
 {
-    uint32_t address = csr_get(HANDLER_REG_INDEX);
-    uint32_t cause = csr_get(CAUSE_REG_INDEX);
+    if((uint64_t)address + length > MEMORY_MAPPED_REGISTER_START_ADDRESS){
+        return false;
+    }
 
-    std::stringstream ss;
-    ss << std::hex << currentInstruction.fullInstruction;
-    uint8_t ch;
-    switch(cause){
-        case 1:
-            error_print_and_exit("Emulator: ERROR -> bad instruction " + ss.str() + " not covered" );
-            break;
-        case 2: // timer
-            break;
-        case 3: // terminal
-            //std::cout << "EEEEEEEEEEEEEEEEEEEEEEEEE" << std::endl;
-            ch = get_term_in();
-            set_term_out((uint32_t)ch);
-            break;
-        case 4:   
-            break;
-        default:
-            error_print_and_exit("Emulator: ERROR -> interruption cause value " + std::to_string(cause) + " not covered" );
-            break;
+    for(uint32_t i = 0; i < length; i ++){
+        buffer[i] = memory.read_byte(address + i);
+        page_used(address + i, PAGE_READ);
     }
 
-    // jump
-    gprx_set(PC_INDEX, address);
+    return true;
 }
 
-Emulator::Instruction Emulator::get_instruction()
+/**
+ * Copies a host buffer into guest memory. The range must not reach the memory mapped registers.
+ */
+bool Emulator::memory_write_block(uint32_t address, const unsigned char* buffer, uint32_t length)
 {
-    unsigned char byte0;
-    unsigned char byte1;
-    unsigned char byte2;
-    unsigned char byte3;
+    if((uint64_t)address + length > MEMORY_MAPPED_REGISTER_START_ADDRESS){
+        return false;
+    }
 
-    uint32_t pc = gprx_get(PC_INDEX);
-    
-    //std::cout << pc << std::endl;
-    byte0 = memory[pc];
-    byte1 = memory[pc + 1];
-    byte2 = memory[pc + 2];
-    byte3 = memory[pc + 3];
+    if(fuzzing){
+        undo_log_record(address, length);
+    }
 
-    uint32_t instruction = 0;
-    instruction |= (int)byte0;
-    instruction |= ( (int)byte1 << 8 ); 
-    instruction |= ( (int)byte2 << 16 ); 
-    instruction |= ( (int)byte3 << 24 ); 
-    // if (pc == 0xf0000060){
-    //     std::cout << std::hex << instruction << std::endl;
-    // }
-  
-    //std::cout << std::hex << uint32_t(pc) << ": " << instruction << std::endl;
-    Instruction retInst;
+    for(uint32_t i = 0; i < length; i ++){
+        memory.write_byte(address + i, buffer[i]);
+        page_used(address + i, PAGE_WRITTEN);
+    }
 
+    if(options.lockstep){
+        deviceWrites.push_back({virtualClock + executingInstruction, address, std::vector<unsigned char>(buffer, buffer + length)});
+    }
 
-    retInst.oc = (instruction >> 28) & 0x0000000F;
-    retInst.mod = ( (instruction << 4) >> 28 ) & 0x0000000F;
-    retInst.regA = ( (instruction << 8) >> 28 ) & 0x0000000F;
-    retInst.regB = ( (instruction << 12) >> 28 ) & 0x0000000F;
-    retInst.regC = ( (instruction << 16) >> 28 ) & 0x0000000F;
-    retInst.disp = ( instruction & 0x00000FFF);
-    retInst.fullInstruction = instruction;
-    //std::cout << retInst.oc << std::endl;
-    // sign extend disp
-    if(retInst.disp & 0x800){
-        retInst.disp |= 0xFFFFF000;
+    invalidate_code(address, length);
+
+    return true;
+}
+
+/**
+ * Device registers updated by the devices themselves: no memory mapped side effects.
+ */
+void Emulator::device_set_word(uint32_t address, uint32_t value)
+{
+    unsigned char bytes[WORD_SIZE] = {
+        (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24)
+    };
+
+    if(fuzzing){
+        undo_log_record(address, WORD_SIZE);
     }
 
-    gprx_set(PC_INDEX, pc + 4);
-    //std::cout << gprx_get(PC_INDEX) << std::endl;
-    return retInst;
+    for(uint32_t i = 0; i < WORD_SIZE; i ++){
+        memory.write_byte(address + i, bytes[i]);
+    }
+
+    // written while the instruction executes: visible from the next one on
+    if(options.lockstep){
+        deviceWrites.push_back({virtualClock + executingInstruction, address, std::vector<unsigned char>(bytes, bytes + WORD_SIZE)});
+    }
+
+    invalidate_code(address, WORD_SIZE);
 }
 
-void Emulator::set_term_out(uint32_t value)
+/**
+ * Reads a word without the side effects of a cpu load, false if its page was never touched.
+ */
+bool Emulator::memory_peek_word(uint32_t address, uint32_t& value)
 {
-    memory_set_word(TERM_OUT_REG_ADDRESS, value);
+    value = memory.read_word(address);
+
+    return memory.is_mapped(address) && memory.is_mapped(address + WORD_SIZE - 1);
 }
 
-uint32_t Emulator::get_term_out()
+/**
+ * Guest memory changed: drop what the fast engines derived from the code that was there.
+ */
+void Emulator::invalidate_code(uint32_t address, uint32_t length)
 {
-    return memory_get_word(TERM_OUT_REG_ADDRESS);
+    if(predecoded.empty() && translatedWords.empty()){
+        return;
+    }
+
+    for(uint64_t word = address & ~(WORD_SIZE - 1); word < (uint64_t)address + length; word += WORD_SIZE){
+        predecoded.erase(word);
+        if(!translatedWords.empty()){
+            invalidate_translated_word(word);
+        }
+    }
 }
 
-void Emulator::set_term_in(uint32_t value)
+/**
+ * Side effects of cpu stores into memory mapped registers.
+ */
+void Emulator::mmio_write(uint32_t address, uint32_t value)
 {
-    memory_set_word(TERM_IN_REG_ADDRESS, value);
+    if(!devicesEnabled){
+        return;
+    }
+
+    devices.written(address, value);
 }
 
-uint32_t Emulator::get_term_in()
+void Emulator::interruption()
 {
-    return memory_get_word(TERM_IN_REG_ADDRESS);
+    uint32_t cause = csr_get(CAUSE_REG_INDEX);
+
+    std::stringstream ss;
+    ss << std::hex << currentInstruction.fullInstruction;
+
+    switch(cause){
+        case CAUSE_BAD_INSTRUCTION:
+            error_print_and_exit("Emulator: ERROR -> bad instruction " + ss.str() + " not covered" );
+            break;
+        case CAUSE_TIMER:
+        case CAUSE_TERMINAL:
+        case CAUSE_SOFTWARE:
+            interrupt_enter(cause);
+            break;
+        default:
+            error_print_and_exit("Emulator: ERROR -> interruption cause value " + std::to_string(cause) + " not covered" );
+            break;
+    }
 }
 
-void Emulator::terminal_check()
+/**
+ * Shared interrupt entry sequence:
+ * push status; push pc; cause<=cause; status<=status&(~0x1); pc<=handle;
+ */
+void Emulator::interrupt_enter(uint32_t cause)
 {
-    if(ready == false){
-        // push status
-        gprx_set(SP_INDEX, gprx_get(SP_INDEX) - 4);
-        memory_set_word(gprx_get(SP_INDEX), gprx_get(STATUS_REG_INDEX));
+    if(trace != nullptr){
+        trace->interrupt(cause);
+    }
 
-        // push pc
-        gprx_set(SP_INDEX, gprx_get(SP_INDEX) - 4);
-        memory_set_word(gprx_get(SP_INDEX), gprx_get(PC_INDEX));
+    // push status
+    gprx_set(SP_INDEX, gprx_get(SP_INDEX) - 4);
+    memory_set_word(gprx_get(SP_INDEX), csr_get(STATUS_REG_INDEX));
 
-        // cause <= 4
-        csr_set(CAUSE_REG_INDEX, 3);
+    // push pc
+    gprx_set(SP_INDEX, gprx_get(SP_INDEX) - 4);
+    memory_set_word(gprx_get(SP_INDEX), gprx_get(PC_INDEX));
 
-        // status<=status&(~0x1);
-        csr_set(STATUS_REG_INDEX, csr_get(STATUS_REG_INDEX) & (~0x1));
+    // cause <= cause
+    csr_set(CAUSE_REG_INDEX, cause);
 
-        interruption();
+    // status<=status&(~0x1);
+    csr_set(STATUS_REG_INDEX, csr_get(STATUS_REG_INDEX) & (~0x1));
 
-        ready = true;
+    if(options.interruptStats){
+        uint64_t now = InterruptController::now();
+        InterruptTiming& timing = interruptTimings[cause];
 
-        cv.notify_one();
+        // software interrupts and bad instructions are entered by the instruction that raised them
+        if(pendingSeen & (1u << cause)){
+            timing.latency.record(virtualClock - pendingSince[cause]);
+            timing.latencyNanoseconds.record(now - std::min(now, interruptController.get_raise_time(cause)));
+            pendingSeen &= ~(1u << cause);
+        } else {
+            timing.latency.record(0);
+            timing.latencyNanoseconds.record(0);
+        }
+
+        interruptFrames.push_back({ cause, gprx_get(SP_INDEX), virtualClock, now });
     }
+
+    sp_seen(gprx[SP_INDEX]);
+
+    // jump
+    gprx_set(PC_INDEX, csr_get(HANDLER_REG_INDEX));
+
+    fuzz_edge(gprx[PC_INDEX] ^ cause);
 }
 
-void Emulator::print_end_state()
+/**
+ * --interrupt-stats: starts the instruction count of every interrupt that became pending since the last check.
+ */
+void Emulator::interrupt_pending_seen()
 {
-    // Print halt message
-    std::cout << "-----------------------------------------------------------------" << std::endl;
-    std::cout << "Emulated processor executed halt instruction" << std::endl;
-    std::cout << "Emulated processor state:" << std::endl;
-    
+    uint32_t fresh = interruptController.get_pending() & ~pendingSeen;
+
+    for(uint32_t cause = 0; fresh != 0; cause ++, fresh >>= 1){
+        if(fresh & 1){
+            pendingSince[cause] = virtualClock;
+            pendingSeen |= 1u << cause;
+        }
+    }
+}
+
+/**
+ * pc is about to be loaded from address. Loading it from where the innermost handler entry pushed 
+ * pc is that handler's iret. Loads from below are returns inside the handler, a load from above
+ * means the guest left the handler without iret and its frame is dropped.
+ */
+void Emulator::interrupt_return_check(uint32_t address)
+{
+    while(!interruptFrames.empty() && interruptFrames.back().frameAddress < address){
+        interruptFrames.pop_back();
+    }
+
+    if(interruptFrames.empty() || interruptFrames.back().frameAddress != address){
+        return;
+    }
+
+    InterruptFrame& frame = interruptFrames.back();
+    InterruptTiming& timing = interruptTimings[frame.cause];
+    timing.duration.record(virtualClock - frame.entryTime);
+    timing.durationNanoseconds.record(InterruptController::now() - frame.entryNanoseconds);
+    interruptFrames.pop_back();
+}
+
+/**
+ * --memory-stats: sp changed. It stays on the stack it is close to, moving further than
+ * STACK_SWITCH_DISTANCE from every stack seen so far (like ld $..., %sp) starts a new one.
+ */
+void Emulator::stack_update(uint32_t sp)
+{
+    lastSp = sp;
+
+    for(Stack& stack: stacks){
+        if((uint64_t)sp + STACK_SWITCH_DISTANCE >= stack.lowest && sp <= (uint64_t)stack.top + STACK_SWITCH_DISTANCE){
+            stack.lowest = std::min(stack.lowest, sp);
+            stack.top = std::max(stack.top, sp);
+            return;
+        }
+    }
+
+    stacks.push_back({ sp, sp });
+}
+
+/**
+ * Pages between the lowest and the highest sp of a stack are stack, the other pages 
+ * instructions were executed from are code, everything else the guest touched is data.
+ * Memory mapped registers are not counted.
+ */
+void Emulator::print_memory_statistics()
+{
+    uint32_t codePages = 0;
+    uint32_t dataPages = 0;
+    uint32_t writtenCodePages = 0;
+    std::vector<uint32_t> stackPages(stacks.size(), 0);
+
+    for(uint32_t page = 0; page < pageUse.size(); page ++){
+        uint32_t address = page << PAGE_BITS;
+        if(pageUse[page] == 0){
+            continue;
+        }
+
+        bool stack = false;
+        for(size_t i = 0; i < stacks.size() && !stack; i ++){
+            if((uint64_t)address + PAGE_SIZE > stacks[i].lowest && address <= stacks[i].top){
+                stackPages[i] ++;
+                stack = true;
+            }
+        }
+
+        if(stack || address >= (MEMORY_MAPPED_REGISTER_START_ADDRESS & ~(PAGE_SIZE - 1))){
+            continue;
+        } else if(pageUse[page] & PAGE_FETCHED){
+            codePages ++;
+            if(pageUse[page] & PAGE_WRITTEN){
+                writtenCodePages ++;
+            }
+        } else {
+            dataPages ++;
+        }
+    }
+
+    std::cout << "Memory (" << PAGE_SIZE / 1024 << "KB pages):" << std::endl;
+    std::cout << std::dec << "    code: " << codePages << " pages touched";
+    if(writtenCodePages > 0){
+        std::cout << " (" << writtenCodePages << " also written)";
+    }
+    std::cout << std::endl;
+    std::cout << "    data: " << dataPages << " pages touched" << std::endl;
+
+    for(size_t i = 0; i < stacks.size(); i ++){
+        // sp was set there but nothing was pushed
+        if(stacks[i].top == stacks[i].lowest){
+            continue;
+        }
+
+        std::cout << "    stack: sp 0x" << std::hex << std::setw(8) << std::setfill('0') << stacks[i].top
+            << " down to 0x" << std::setw(8) << stacks[i].lowest << std::dec << std::setfill(' ')
+            << ", " << stacks[i].top - stacks[i].lowest << " bytes deep, " << stackPages[i] << " pages touched" << std::endl;
+    }
+
+    uint64_t privateBytes = (uint64_t)memory.get_private_pages() * PAGE_SIZE;
+    uint64_t sharedBytes = (uint64_t)memory.get_shared_pages() * PAGE_SIZE;
+    std::cout << "    resident guest memory: " << (privateBytes + sharedBytes) / 1024 << "KB ("
+        << privateBytes / 1024 << "KB private, " << sharedBytes / 1024 << "KB mapped from the shared image, "
+        << memory.get_copied_pages() << " image pages copied on write)" << std::endl;
+
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+        std::cout << "    peak host resident set: " << usage.ru_maxrss << "KB" << std::endl;
+    }
+}
+
+void Emulator::print_interrupt_statistics()
+{
+    const char* causeNames[] = { "", "bad instruction", "timer", "terminal", "software", "block" };
+
+    std::cout << "Interrupts (latency: raise to handler entry, duration: handler entry to iret):" << std::endl;
+    if(interruptTimings.empty()){
+        std::cout << "    none taken" << std::endl;
+    }
+
+    auto print = [](const char* name, LatencyHistogram& instructions, LatencyHistogram& nanoseconds){
+        std::cout << "        " << std::left << std::setw(9) << name << std::right
+            << "instructions p50 " << std::setw(8) << instructions.percentile(0.5)
+            << " p99 " << std::setw(8) << instructions.percentile(0.99)
+            << " max " << std::setw(8) << instructions.get_max()
+            << " | us p50 " << std::setw(8) << nanoseconds.percentile(0.5) / 1000.0
+            << " p99 " << std::setw(8) << nanoseconds.percentile(0.99) / 1000.0
+            << " max " << std::setw(8) << nanoseconds.get_max() / 1000.0 << std::endl;
+    };
+
+    for(auto& pair: interruptTimings){
+        InterruptTiming& timing = pair.second;
+
+        std::cout << "    cause " << std::dec << pair.first;
+        if(pair.first < sizeof(causeNames) / sizeof(causeNames[0])){
+            std::cout << " (" << causeNames[pair.first] << ")";
+        }
+        std::cout << ": " << timing.latency.get_count() << " taken, " << timing.duration.get_count() << " returned" << std::endl;
+
+        std::cout << std::fixed << std::setprecision(1) << std::setfill(' ');
+        print("latency", timing.latency, timing.latencyNanoseconds);
+        if(timing.duration.get_count() > 0){
+            print("duration", timing.duration, timing.durationNanoseconds);
+        }
+    }
+}
+
+/**
+ * Called at basic block ends when the interrupt controller has something pending.
+ */
+void Emulator::interrupt_check()
+{
+    if(options.interruptStats){
+        interrupt_pending_seen();
+    }
+
+    uint32_t cause = interruptController.acknowledge(csr_get(STATUS_REG_INDEX));
+    uint8_t ch;
+
+    switch(cause){
+        case 0: // everything pending is masked
+            return;
+        case CAUSE_TERMINAL:
+            // next character from the I/O thread, or the one the fuzzer latched
+            if(inputQueue.pop(ch)){
+                terminalInput.store(ch);
+
+                if(!inputQueue.empty()){
+                    interruptController.raise(CAUSE_TERMINAL);
+                }
+
+                // the I/O thread waits for room before it reads stdin again
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(inputBlocked.exchange(false)){
+                    wake_io();
+                }
+            } else if(terminalLatched){
+                terminalLatched = false;
+            } else {
+                // late raise of the I/O thread for a character a re-raise already delivered
+                return;
+            }
+
+            // device latch -> term_in register
+            device_set_word(TERM_IN_REG_ADDRESS, terminalInput.load());
+            ch = get_term_in();
+            device_set_word(TERM_OUT_REG_ADDRESS, (uint32_t)ch);
+
+            interrupt_enter(CAUSE_TERMINAL);
+            takenInterrupt = CAUSE_TERMINAL;
+            break;
+        default:
+            interrupt_enter(cause);
+            takenInterrupt = cause;
+            break;
+    }
+}
+
+Emulator::Instruction Emulator::get_instruction()
+{
+    unsigned char byte0;
+    unsigned char byte1;
+    unsigned char byte2;
+    unsigned char byte3;
+
+    uint32_t pc = gprx_get(PC_INDEX);
+    currentInstructionAddress = pc;
+
+#ifdef CACHE_MODEL
+    instructionCache->access(pc, pc);
+#endif
+    
+    //std::cout << pc << std::endl;
+    byte0 = memory.read_byte(pc);
+    byte1 = memory.read_byte(pc + 1);
+    byte2 = memory.read_byte(pc + 2);
+    byte3 = memory.read_byte(pc + 3);
+
+    uint32_t instruction = 0;
+    instruction |= (int)byte0;
+    instruction |= ( (int)byte1 << 8 ); 
+    instruction |= ( (int)byte2 << 16 ); 
+    instruction |= ( (int)byte3 << 24 ); 
+    // if (pc == 0xf0000060){
+    //     std::cout << std::hex << instruction << std::endl;
+    // }
+  
+    //std::cout << std::hex << uint32_t(pc) << ": " << instruction << std::endl;
+    Instruction retInst = decode(instruction);
+
+    gprx_set(PC_INDEX, pc + 4);
+    //std::cout << gprx_get(PC_INDEX) << std::endl;
+    return retInst;
+}
+
+Emulator::Instruction Emulator::decode(uint32_t instruction)
+{
+    Instruction retInst;
+
+    retInst.oc = (instruction >> 28) & 0x0000000F;
+    retInst.mod = ( (instruction << 4) >> 28 ) & 0x0000000F;
+    retInst.regA = ( (instruction << 8) >> 28 ) & 0x0000000F;
+    retInst.regB = ( (instruction << 12) >> 28 ) & 0x0000000F;
+    retInst.regC = ( (instruction << 16) >> 28 ) & 0x0000000F;
+    retInst.disp = ( instruction & 0x00000FFF);
+    retInst.fullInstruction = instruction;
+    //std::cout << retInst.oc << std::endl;
+    // sign extend disp
+    if(retInst.disp & 0x800){
+        retInst.disp |= 0xFFFFF000;
+    }
+
+    return retInst;
+}
+
+/**
+ * Predecode engine: instructions are decoded once and reused until the guest writes the word.
+ */
+Emulator::Instruction Emulator::get_predecoded_instruction()
+{
+    uint32_t pc = gprx[PC_INDEX];
+
+    if(pc % WORD_SIZE != 0){
+        return get_instruction();
+    }
+
+    // pages of the image nobody stored into are decoded once for every instance
+    const Instruction* instruction;
+    int32_t sharedIndex = memory.shared_index(pc);
+
+    if(sharedIndex >= 0){
+        instruction = &image->decoded[sharedIndex][(pc & (PAGE_SIZE - 1)) / WORD_SIZE];
+    } else {
+        auto it = predecoded.find(pc);
+        if(it == predecoded.end()){
+            Instruction decoded = get_instruction();
+            predecoded[pc] = decoded;
+            return decoded;
+        }
+        instruction = &it->second;
+    }
+
+    currentInstructionAddress = pc;
+
+#ifdef CACHE_MODEL
+    instructionCache->access(pc, pc);
+#endif
+
+    gprx[PC_INDEX] = pc + WORD_SIZE;
+    return *instruction;
+}
+
+void Emulator::set_term_out(uint32_t value)
+{
+    memory_set_word(TERM_OUT_REG_ADDRESS, value);
+}
+
+uint32_t Emulator::get_term_out()
+{
+    return memory_get_word(TERM_OUT_REG_ADDRESS);
+}
+
+void Emulator::set_term_in(uint32_t value)
+{
+    memory_set_word(TERM_IN_REG_ADDRESS, value);
+}
+
+uint32_t Emulator::get_term_in()
+{
+    return memory_get_word(TERM_IN_REG_ADDRESS);
+}
+
+void Emulator::init_translated_code()
+{
+    // lockstep compares block by block, the trace and the memory statistics see every
+    // instruction, translated code runs many blocks at once
+    if(translatedCodeRegistry == nullptr || options.lockstep || trace != nullptr || options.memoryStats){
+        return;
+    }
+
+    if(!translatedCodeRegistry->verify(*this)){
+        std::cerr << "Emulator: Warning -> " << inputFileName << " is not the image that was translated, interpreting it instead\n";
+        return;
+    }
+
+    translatedCode = translatedCodeRegistry;
+    for(int i = 0; i < translatedCode->numberOfAddresses; i ++){
+        translatedWords[translatedCode->addresses[i]] = translatedCode->blocks[i];
+    }
+    invalidBlocks.assign(translatedCode->numberOfBlocks, 0);
+}
+
+void Emulator::init_trace()
+{
+    if(options.traceFile.empty()){
+        return;
+    }
+
+    trace = new TraceRecorder(options.traceFile);
+
+    if(!trace->is_open()){
+        std::cerr << "Emulator: ERROR -> Could not open trace file " << options.traceFile << "\n";
+        my_exit();
+    }
+}
+
+/**
+ * --perf: host perf gets a symbol for every translated block, the guest pc is sampled
+ * every PERF_SAMPLE_INTERVAL of cpu time so guest hot spots can be set next to host ones.
+ */
+void Emulator::init_perf()
+{
+    if(!options.perf){
+        return;
+    }
+
+    if(translatedCode != nullptr){
+        write_perf_map();
+    }
+
+    samples = new uint32_t[PERF_MAX_SAMPLES];
+    sampledPc = &gprx[PC_INDEX];
+
+    struct sigaction action = {};
+    action.sa_handler = &Emulator::sample_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+
+    struct itimerval timer = {};
+    timer.it_interval.tv_usec = PERF_SAMPLE_INTERVAL;
+    timer.it_value.tv_usec = PERF_SAMPLE_INTERVAL;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+/**
+ * Lock free: one slot per sample, samples over PERF_MAX_SAMPLES are only counted.
+ */
+void Emulator::sample_handler(int signal)
+{
+    uint32_t index = numberOfSamples.fetch_add(1, std::memory_order_relaxed);
+
+    if(index < PERF_MAX_SAMPLES){
+        samples[index] = *sampledPc;
+    }
+}
+
+/**
+ * /tmp/perf-<pid>.map, one "<start> <size> <name>" line per translated block.
+ */
+void Emulator::write_perf_map()
+{
+    describeTranslatedCode = true;
+    translatedCode->run(*this);
+    describeTranslatedCode = false;
+
+    // guest address of every block: its first instruction
+    std::vector<uint32_t> guestAddresses(translatedCode->numberOfBlocks, 0);
+    for(int i = translatedCode->numberOfAddresses - 1; i >= 0; i --){
+        guestAddresses[translatedCode->blocks[i]] = translatedCode->addresses[i];
+    }
+
+    // the compiler does not keep the blocks in order, the size of a block goes up to the next one in memory
+    std::vector<std::pair<uintptr_t, int>> starts;
+    for(int i = 0; i <= translatedCode->numberOfBlocks; i ++){
+        starts.push_back(std::make_pair((uintptr_t)translatedBlockStarts[i], i));
+    }
+    std::sort(starts.begin(), starts.end());
+
+    std::string fileName = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    std::ofstream file(fileName);
+
+    if(!file.is_open()){
+        std::cerr << "Emulator: Warning -> Could not write " << fileName << "\n";
+        return;
+    }
+
+    for(size_t i = 0; i + 1 < starts.size(); i ++){
+        int block = starts[i].second;
+        uintptr_t size = starts[i + 1].first - starts[i].first;
+
+        if(block == translatedCode->numberOfBlocks || size == 0){
+            continue;
+        }
+
+        file << std::hex << starts[i].first << " " << size << " guest_" << std::setw(8) << std::setfill('0') << guestAddresses[block];
+        if(!symbolMap.empty()){
+            file << "_" << symbolize(guestAddresses[block]);
+        }
+        file << "\n";
+    }
+
+    file.close();
+}
+
+void Emulator::print_samples()
+{
+    struct itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+
+    uint32_t total = numberOfSamples.load();
+    uint32_t recorded = std::min<uint32_t>(total, PERF_MAX_SAMPLES);
+
+    std::unordered_map<uint32_t, uint32_t> perPc;
+    std::map<std::string, uint32_t> perSymbol;
+    for(uint32_t i = 0; i < recorded; i ++){
+        perPc[samples[i]] ++;
+        if(!symbolMap.empty()){
+            perSymbol[symbolize(samples[i])] ++;
+        }
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> hottest(perPc.begin(), perPc.end());
+    std::sort(hottest.begin(), hottest.end(), [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b){
+        return a.second > b.second;
+    });
+
+    std::cout << "Guest pc samples: " << std::dec << total;
+    if(total > recorded){
+        std::cout << " (" << total - recorded << " not recorded)";
+    }
+    std::cout << std::endl;
+
+    for(size_t i = 0; i < hottest.size() && i < 10; i ++){
+        std::cout << "    0x" << std::hex << std::setw(8) << std::setfill('0') << hottest[i].first << std::dec << std::setfill(' ')
+            << " " << std::right << std::setw(8) << hottest[i].second << " " << std::fixed << std::setprecision(2) << 100.0 * hottest[i].second / recorded << "%";
+        if(!symbolMap.empty()){
+            std::cout << " " << symbolize(hottest[i].first);
+        }
+        std::cout << std::endl;
+    }
+
+    for(auto& pair: perSymbol){
+        std::cout << "    " << pair.first << ": " << std::fixed << std::setprecision(2) << 100.0 * pair.second / recorded << "%" << std::endl;
+    }
+}
+
+void Emulator::invalidate_translated_word(uint32_t address)
+{
+    auto it = translatedWords.find(address);
+    if(it == translatedWords.end()){
+        return;
+    }
+
+    invalidBlocks[it->second] = 1;
+    codeModified = true;
+}
+
+/**
+ * Loads the image and devices like powerOn does and takes the snapshot every input starts from.
+ * No terminal thread: the terminal is fed from the fuzzer input.
+ */
+void Emulator::fuzz_init()
+{
+    init_hardware();
+    init_memory();
+    init_symbol_map();
+    init_semihosting();
+    init_block_device();
+    start_devices();
+
+    for(int i = 0; i < 16; i ++){
+        snapshotGprx[i] = gprx[i];
+    }
+    for(int i = 0; i < 3; i ++){
+        snapshotCsr[i] = csr[i];
+    }
+
+    fuzzing = true;
+}
+
+/**
+ * Runs the guest with the input typed on the terminal, one character every FUZZ_INPUT_INTERVAL
+ * ticks. The input ends at halt, FUZZ_INPUT_INTERVAL ticks after the last character, or when 
+ * the instruction budget is used up.
+ */
+void Emulator::fuzz_one_input(const uint8_t* data, size_t size)
+{
+    fuzzInput = data;
+    fuzzInputSize = size;
+    fuzzInputPosition = 0;
+    fuzzEndTime = FUZZ_INSTRUCTION_BUDGET;
+
+    schedule(FUZZ_INPUT_INTERVAL, [this]{ fuzz_deliver_input(); });
+
+    while(!halted && virtualClock < fuzzEndTime){
+        step();
+    }
+
+    fuzz_restore();
+}
+
+void Emulator::fuzz_deliver_input()
+{
+    if(fuzzInputPosition == fuzzInputSize){
+        fuzzEndTime = std::min(fuzzEndTime, virtualClock + FUZZ_INPUT_INTERVAL);
+        return;
+    }
+
+    // a character the guest did not take yet is overwritten, like an uart overrun
+    terminalInput.store(fuzzInput[fuzzInputPosition++]);
+    terminalLatched = true;
+    interruptController.raise(CAUSE_TERMINAL);
+
+    schedule(FUZZ_INPUT_INTERVAL, [this]{ fuzz_deliver_input(); });
+}
+
+void Emulator::undo_log_record(uint32_t address, uint32_t length)
+{
+    for(uint32_t i = 0; i < length; i ++){
+        undoLog.push_back({address + i, memory.read_byte(address + i)});
+    }
+}
+
+/**
+ * Back to the snapshot: memory from the undo log, registers and devices from scratch.
+ * Writes to the disk image are not undone.
+ */
+void Emulator::fuzz_restore()
+{
+    for(auto it = undoLog.rbegin(); it != undoLog.rend(); it ++){
+        memory.write_byte(it->address, it->oldValue);
+        invalidate_code(it->address, 1);
+    }
+    undoLog.clear();
+
+    for(int i = 0; i < 16; i ++){
+        gprx[i] = snapshotGprx[i];
+    }
+    for(int i = 0; i < 3; i ++){
+        csr[i] = snapshotCsr[i];
+    }
+
+    virtualClock = 0;
+    scheduledEvents = decltype(scheduledEvents)();
+    nextEventTime = UINT64_MAX;
+    interruptController.reset();
+    terminalInput.store(0);
+    terminalLatched = false;
+    devices.reset();
+    start_devices();
+    halted = false;
+    previousLocation = 0;
+    interruptFrames.clear();
+    pendingSeen = 0;
+
+    for(auto& file: semihostFiles){
+        close(file.second);
+    }
+    semihostFiles.clear();
+    semihostNextFd = 3;
+}
+
+/**
+ * Runs the action once the virtual clock advances by delay.
+ */
+void Emulator::schedule(uint64_t delay, std::function<void()> action)
+{
+    ScheduledEvent event;
+    event.time = virtualClock + delay;
+    event.action = action;
+
+    scheduledEvents.push(event);
+    nextEventTime = scheduledEvents.top().time;
+}
+
+void Emulator::run_scheduled_events()
+{
+    while(!scheduledEvents.empty() && scheduledEvents.top().time <= virtualClock){
+        ScheduledEvent event = scheduledEvents.top();
+        scheduledEvents.pop();
+        event.action();
+    }
+
+    nextEventTime = scheduledEvents.empty() ? UINT64_MAX : scheduledEvents.top().time;
+}
+
+void Emulator::start_devices()
+{
+    devices.start(terminal_output_device());
+    devices.start(timer_device());
+    devices.start(semihost_device());
+    devices.start(block_device());
+}
+
+/**
+ * term_out: every character the guest stores goes to the I/O thread, if there is one.
+ */
+DeviceTask Emulator::terminal_output_device()
+{
+    while(true){
+        RegisterWrite write = co_await devices.register_write(TERM_OUT_REG_ADDRESS);
+
+        if(outputPipe[1] >= 0){
+            unsigned char ch = write.value;
+            if(::write(outputPipe[1], &ch, 1) < 0){
+                error_print_and_exit("Emulator: ERROR -> Could not write terminal output");
+            }
+        }
+    }
+}
+
+/**
+ * tim_cfg: a write (re)starts the timer with the selected period. With the I/O thread the
+ * timer runs on the wall clock (timerfd), without it (fuzzing) on the virtual clock.
+ */
+DeviceTask Emulator::timer_device()
+{
+    const uint64_t periods[] = TIMER_PERIODS;
+    uint64_t timeout = NO_TIMEOUT;
+
+    while(true){
+        RegisterWrite write = co_await devices.register_write(TIM_CFG_REG_ADDRESS, timeout);
+
+        if(!write.written){
+            interruptController.raise(CAUSE_TIMER);
+            continue;
+        }
+
+        uint64_t period = periods[write.value % (sizeof(periods) / sizeof(periods[0]))];
+
+        if(timerFd >= 0){
+            struct itimerspec spec = {};
+            spec.it_interval.tv_sec = period / 1000;
+            spec.it_interval.tv_nsec = (period % 1000) * 1000000;
+            spec.it_value = spec.it_interval;
+            timerfd_settime(timerFd, 0, &spec, nullptr);
+        } else {
+            timeout = period * TIMER_TICKS_PER_MILLISECOND;
+        }
+    }
+}
+
+DeviceTask Emulator::semihost_device()
+{
+    while(true){
+        RegisterWrite operation = co_await devices.register_write(SEMIHOST_OP_REG_ADDRESS);
+        semihost_call(operation.value);
+    }
+}
+
+/**
+ * BLOCK_COMMAND: the transfer happens BLOCK_LATENCY (+ per sector) ticks after the command.
+ * Commands written while a transfer is in flight are ignored, one command at a time.
+ */
+DeviceTask Emulator::block_device()
+{
+    while(true){
+        RegisterWrite command = co_await devices.register_write(BLOCK_COMMAND_REG_ADDRESS);
+
+        uint32_t sector = memory_get_word(BLOCK_SECTOR_REG_ADDRESS);
+        uint32_t buffer = memory_get_word(BLOCK_BUFFER_REG_ADDRESS);
+        uint32_t count = memory_get_word(BLOCK_COUNT_REG_ADDRESS);
+
+        if(diskData == nullptr || (command.value != BLOCK_COMMAND_READ && command.value != BLOCK_COMMAND_WRITE)){
+            device_set_word(BLOCK_STATUS_REG_ADDRESS, BLOCK_STATUS_ERROR);
+            interruptController.raise(CAUSE_BLOCK);
+            continue;
+        }
+
+        device_set_word(BLOCK_STATUS_REG_ADDRESS, BLOCK_STATUS_BUSY);
+
+        co_await devices.delay(BLOCK_LATENCY + (uint64_t)count * BLOCK_LATENCY_PER_SECTOR);
+
+        uint64_t offset = (uint64_t)sector * BLOCK_SECTOR_SIZE;
+        uint64_t length = (uint64_t)count * BLOCK_SECTOR_SIZE;
+        bool ok = offset + length <= diskSize && length <= UINT32_MAX;
+
+        if(ok && command.value == BLOCK_COMMAND_READ){
+            ok = memory_write_block(buffer, diskData + offset, length);
+        } else if(ok){
+            ok = memory_read_block(buffer, diskData + offset, length);
+        }
+
+        device_set_word(BLOCK_STATUS_REG_ADDRESS, ok ? BLOCK_STATUS_DONE : BLOCK_STATUS_ERROR);
+        interruptController.raise(CAUSE_BLOCK);
+    }
+}
+
+void Emulator::init_block_device()
+{
+    if(options.diskImage.empty()){
+        return;
+    }
+
+    int fd = open(options.diskImage.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat st;
+
+    if(fd < 0 || fstat(fd, &st) != 0 || st.st_size < BLOCK_SECTOR_SIZE){
+        std::cerr << "Emulator: ERROR -> Could not open disk image " << options.diskImage << "\n";
+        my_exit();
+    }
+
+    diskSize = st.st_size - st.st_size % BLOCK_SECTOR_SIZE;
+    diskData = (unsigned char*)mmap(nullptr, diskSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(diskData == MAP_FAILED){
+        diskData = nullptr;
+        std::cerr << "Emulator: ERROR -> Could not map disk image " << options.diskImage << "\n";
+        my_exit();
+    }
+}
+
+void Emulator::init_semihosting()
+{
+    if(options.semihostDirectory.empty()){
+        return;
+    }
+
+    semihostDirectoryFd = open(options.semihostDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if(semihostDirectoryFd < 0){
+        std::cerr << "Emulator: ERROR -> Could not open semihosting directory " << options.semihostDirectory << "\n";
+        my_exit();
+    }
+}
+
+/**
+ * Opens a file inside of the sandbox directory. Absolute paths, ".." and symbolic links 
+ * that would leave the sandbox are refused.
+ */
+int Emulator::semihost_open(std::string path, int flags)
+{
+    if(path.empty() || path[0] == '/'){
+        return -1;
+    }
+
+    struct open_how how = {};
+    how.flags = flags | O_CLOEXEC | O_NOFOLLOW;
+    how.mode = (flags & O_CREAT) ? 0644 : 0;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS | RESOLVE_NO_SYMLINKS;
+
+    int fd = syscall(SYS_openat2, semihostDirectoryFd, path.c_str(), &how, sizeof(how));
+    if(fd >= 0 || errno != ENOSYS){
+        return fd;
+    }
+
+    // kernels without openat2: walk the path one directory at a time, no ".." and no
+    // symbolic link in any component
+    std::vector<std::string> components;
+    std::stringstream ss(path);
+    std::string component;
+    while(std::getline(ss, component, '/')){
+        if(component == ".."){
+            return -1;
+        }
+        if(!component.empty() && component != "."){
+            components.push_back(component);
+        }
+    }
+
+    if(components.empty()){
+        return -1;
+    }
+
+    int directoryFd = semihostDirectoryFd;
+    for(size_t i = 0; i + 1 < components.size(); i ++){
+        int next = openat(directoryFd, components[i].c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if(directoryFd != semihostDirectoryFd){
+            close(directoryFd);
+        }
+        if(next < 0){
+            return -1;
+        }
+        directoryFd = next;
+    }
+
+    fd = openat(directoryFd, components.back().c_str(), flags | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if(directoryFd != semihostDirectoryFd){
+        close(directoryFd);
+    }
+    return fd;
+}
+
+/**
+ * One host call with the whole buffer transferred at once.
+ * Result is written into SEMIHOST_RESULT.
+ */
+void Emulator::semihost_call(uint32_t operation)
+{
+    uint32_t ptr = memory_get_word(SEMIHOST_PTR_REG_ADDRESS);
+    uint32_t len = memory_get_word(SEMIHOST_LEN_REG_ADDRESS);
+    uint32_t guestFd = memory_get_word(SEMIHOST_FD_REG_ADDRESS);
+    uint32_t result = SEMIHOST_ERROR;
+
+    std::vector<unsigned char> buffer;
+    std::map<uint32_t, int>::iterator file = semihostFiles.find(guestFd);
+    int hostFd;
+    ssize_t count;
+
+    if(semihostDirectoryFd < 0){
+        device_set_word(SEMIHOST_RESULT_REG_ADDRESS, SEMIHOST_ERROR);
+        return;
+    }
+
+    // bigger transfers are done partially, like read(2) and write(2) do.
+    if(len > SEMIHOST_MAX_TRANSFER){
+        len = SEMIHOST_MAX_TRANSFER;
+    }
+
+    // the whole guest buffer must be ordinary memory.
+    if((uint64_t)ptr + len > MEMORY_MAPPED_REGISTER_START_ADDRESS){
+        device_set_word(SEMIHOST_RESULT_REG_ADDRESS, SEMIHOST_ERROR);
+        return;
+    }
+
+    switch(operation){
+        case SEMIHOST_OPEN_READ:
+        case SEMIHOST_OPEN_WRITE:
+            if(len == 0 || len > SEMIHOST_MAX_PATH || semihostFiles.size() >= SEMIHOST_MAX_OPEN_FILES){
+                break;
+            }
+            buffer.resize(len);
+            if(!memory_read_block(ptr, buffer.data(), len)){
+                break;
+            }
+            hostFd = semihost_open(
+                std::string(buffer.begin(), buffer.end()),
+                operation == SEMIHOST_OPEN_READ ? O_RDONLY : (O_WRONLY | O_CREAT | O_TRUNC)
+            );
+            if(hostFd < 0){
+                break;
+            }
+            semihostFiles[semihostNextFd] = hostFd;
+            result = semihostNextFd++;
+            break;
+        case SEMIHOST_READ:
+            if(file == semihostFiles.end()){
+                break;
+            }
+            buffer.resize(len);
+            count = read(file->second, buffer.data(), len);
+            if(count < 0 || !memory_write_block(ptr, buffer.data(), count)){
+                break;
+            }
+            result = count;
+            break;
+        case SEMIHOST_WRITE:
+            if(file == semihostFiles.end()){
+                break;
+            }
+            buffer.resize(len);
+            if(!memory_read_block(ptr, buffer.data(), len)){
+                break;
+            }
+            count = write(file->second, buffer.data(), len);
+            if(count < 0){
+                break;
+            }
+            result = count;
+            break;
+        case SEMIHOST_CLOSE:
+            if(file == semihostFiles.end()){
+                break;
+            }
+            close(file->second);
+            semihostFiles.erase(file);
+            result = 0;
+            break;
+        default:
+            break;
+    }
+
+    device_set_word(SEMIHOST_RESULT_REG_ADDRESS, result);
+}
+
+void Emulator::print_end_state()
+{
+    // Print halt message
+    std::cout << "-----------------------------------------------------------------" << std::endl;
+    std::cout << "Emulated processor executed halt instruction" << std::endl;
+    std::cout << "Emulated processor state:" << std::endl;
+    
     // Print the registers in rows of 4, each formatted as hex
     for (int i = 0; i < 15; ++i) {
         // Print the register name (r0, r1, etc.) and value in hexadecimal
@@ -638,6 +1943,34 @@ void Emulator::print_end_state()
     std::cout << "r15=0x" << std::setfill('0') << std::setw(8) << std::hex << gprx[15] << std::endl;
 }
 
+void Emulator::print_statistics()
+{
+    if(options.perf){
+        print_samples();
+    }
+
+    if(options.interruptStats){
+        print_interrupt_statistics();
+    }
+
+    if(options.memoryStats){
+        print_memory_statistics();
+    }
+
+    if(trace != nullptr){
+        std::cout << "Trace: " << std::dec << trace->get_instructions() << " instructions, " << trace->get_bytes() << " bytes ("
+            << std::fixed << std::setprecision(2) << (double)trace->get_bytes() / std::max<uint64_t>(trace->get_instructions(), 1)
+            << " bytes per instruction) -> " << options.traceFile << std::endl;
+    }
+
+#ifdef CACHE_MODEL
+    auto symbolizer = [this](uint32_t address){ return symbolize(address); };
+
+    instructionCache->report(std::cout, symbolizer);
+    dataCache->report(std::cout, symbolizer);
+#endif
+}
+
 void Emulator::disable_echo()
 {
     struct termios tty;
@@ -656,39 +1989,190 @@ void Emulator::enable_echo()
     tcsetattr(STDIN_FILENO, TCSANOW, &tty);  // Set the new attributes immediately
 }
 
-void Emulator::terminal_thread_function()
+/**
+ * Sets up the host I/O thread. The cpu only touches it through the input queue, the output
+ * pipe, the timerfd (timer_device) and the wake eventfd, none of which need a lock.
+ */
+void Emulator::init_io()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if(epollFd < 0 || wakeFd < 0 || timerFd < 0 || pipe2(outputPipe, O_CLOEXEC) < 0){
+        error_print_and_exit("Emulator: ERROR -> Could not set up host I/O");
+    }
+    fcntl(outputPipe[0], F_SETFL, O_NONBLOCK);
+
+    for(int fd: { wakeFd, timerFd, outputPipe[0] }){
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    io = std::thread(&Emulator::io_thread_function, this);
+}
+
+/**
+ * Copies what the guest wrote so far to stdout and stops the I/O thread. Idempotent.
+ */
+void Emulator::stop_io()
+{
+    if(!io.joinable()){
+        return;
+    }
+
+    stopFlag.store(true);
+    wake_io();
+    io.join();
+
+    for(int fd: { epollFd, wakeFd, timerFd, outputPipe[0], outputPipe[1] }){
+        close(fd);
+    }
+    epollFd = wakeFd = timerFd = outputPipe[0] = outputPipe[1] = -1;
+}
+
+void Emulator::wake_io()
+{
+    uint64_t one = 1;
+    if(write(wakeFd, &one, sizeof(one)) < 0){
+        // the counter is already non-zero, the thread wakes up anyway
+    }
+}
+
+/**
+ * Host I/O thread: one epoll loop over stdin, the terminal output pipe, the timerfd and the 
+ * wake eventfd. Characters go to the cpu through the input queue, each batch raises a 
+ * terminal interrupt. While the queue is full stdin is not read, the cpu wakes the thread 
+ * when it takes a character.
+ */
+void Emulator::io_thread_function()
 {
     disable_echo();  // Disable echo and line buffering
-    
-    char ch;
-    while (!stopFlag.load()) {
-        // Wait for a single character to be pressed
-        ch = getchar();
-        if(stopFlag.load()){
+
+    // a regular file can not be polled (EPERM), it is always readable
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = STDIN_FILENO;
+    bool polled = epoll_ctl(epollFd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
+
+    bool inputOpen = true;
+    bool reading = true;
+    struct epoll_event events[4];
+
+    while(true){
+        if(inputOpen && reading && inputQueue.free_space() == 0){
+            inputBlocked.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if(inputQueue.free_space() == 0){
+                reading = false;
+                if(polled){
+                    event.events = 0;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, STDIN_FILENO, &event);
+                }
+            } else {
+                inputBlocked.store(false);
+            }
+        }
+
+        bool readFile = inputOpen && reading && !polled;
+        if(readFile){
+            inputOpen = io_read_input();
+        }
+
+        int count = epoll_wait(epollFd, events, 4, readFile ? 0 : -1);
+        if(count < 0 && errno != EINTR){
             break;
         }
-        set_term_in((uint32_t)ch);
 
-        ready = false;
-       
-        std::unique_lock<std::mutex> lock(mtx);
+        for(int i = 0; i < count; i ++){
+            int fd = events[i].data.fd;
 
-        cv.wait(lock, [this]{ return ready; });
+            if(fd == STDIN_FILENO){
+                if(!io_read_input()){
+                    inputOpen = false;
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+                }
+            } else if(fd == outputPipe[0]){
+                io_copy_output();
+            } else if(fd == timerFd){
+                uint64_t expirations;
+                if(read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)){
+                    interruptController.raise(CAUSE_TIMER);
+                }
+            } else if(fd == wakeFd){
+                uint64_t value;
+                if(read(wakeFd, &value, sizeof(value)) < 0){
+                    // nothing to read, woken by an earlier event
+                }
+
+                if(stopFlag.load()){
+                    io_copy_output();
+                    enable_echo();  // Restore terminal settings
+                    return;
+                }
+
+                if(inputOpen && !reading){
+                    reading = true;
+                    if(polled){
+                        event.events = EPOLLIN;
+                        epoll_ctl(epollFd, EPOLL_CTL_MOD, STDIN_FILENO, &event);
+                    }
+                }
+            }
+        }
     }
 
-    enable_echo();  // Restore terminal settings
+    enable_echo();
+}
+
+/**
+ * Reads as much of stdin as fits into the input queue. False at the end of the input.
+ */
+bool Emulator::io_read_input()
+{
+    unsigned char buffer[INPUT_QUEUE_SIZE];
+
+    ssize_t length = read(STDIN_FILENO, buffer, inputQueue.free_space());
+    if(length < 0 && (errno == EAGAIN || errno == EINTR)){
+        return true;
+    }
+    if(length <= 0){
+        return false;
+    }
 
+    for(ssize_t i = 0; i < length; i ++){
+        inputQueue.push(buffer[i]);
+    }
+    interruptController.raise(CAUSE_TERMINAL);
+
+    return true;
 }
 
-void Emulator::my_exit()
+void Emulator::io_copy_output()
 {
-    stopFlag.store(true);
+    char buffer[4096];
+    ssize_t length;
+
+    while((length = read(outputPipe[0], buffer, sizeof(buffer))) > 0){
+        for(ssize_t written = 0, n; written < length; written += n){
+            n = write(STDOUT_FILENO, buffer + written, length - written);
+            if(n <= 0){
+                return;
+            }
+        }
+    }
+}
 
-    ready = true;
+void Emulator::my_exit()
+{
+    if(trace != nullptr){
+        trace->stop();
+    }
 
-    cv.notify_one();
-    
-    terminal.join();
+    stop_io();
 
-    my_exit();
+    exit(0);
 }
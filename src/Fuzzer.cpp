@@ -0,0 +1,70 @@
+#include "./../inc/Emulator.h"
+#include <sys/shm.h>
+#include <cstdlib>
+
+/**
+ * libFuzzer entry points (make emulator_fuzzer_):
+ *
+ *   ./emulator_fuzzer --image=program.hex [--semihost=<dir>] [--disk=<file>] corpus/
+ *
+ * The image stays loaded, every input is typed on the guest terminal and the guest
+ * state is restored afterwards. Options starting with "--" are ignored by libFuzzer.
+ * Edge coverage goes into the extra counters section libFuzzer picks up, or into the
+ * AFL shared memory bitmap when __AFL_SHM_ID is set.
+ */
+__attribute__((section("__libfuzzer_extra_counters"))) static uint8_t coverageCounters[FUZZ_MAP_SIZE];
+
+uint8_t* fuzzCoverageMap = coverageCounters;
+
+static Emulator* emulator = nullptr;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    EmulatorOptions options;
+    std::string image;
+
+    const char* environmentImage = getenv("EMULATOR_FUZZ_IMAGE");
+    if (environmentImage != nullptr) {
+        image = environmentImage;
+    }
+
+    for (int i = 1; i < *argc; ++i) {
+        std::string arg = (*argv)[i];
+
+        if (arg.rfind("--image=", 0) == 0) {
+            image = arg.substr(8);
+        } else if (arg.rfind("--semihost=", 0) == 0) {
+            options.semihostDirectory = arg.substr(11);
+        } else if (arg.rfind("--disk=", 0) == 0) {
+            options.diskImage = arg.substr(7);
+        } else if (arg == "--predecode") {
+            options.predecode = true;
+        }
+    }
+
+    if (image.empty()) {
+        std::cerr << "Emulator: ERROR -> fuzzing needs --image=<program.hex> or EMULATOR_FUZZ_IMAGE\n";
+        exit(1);
+    }
+
+    const char* shmId = getenv("__AFL_SHM_ID");
+    if (shmId != nullptr) {
+        void* map = shmat(atoi(shmId), nullptr, 0);
+        if (map == (void*)-1) {
+            std::cerr << "Emulator: ERROR -> Could not attach AFL shared memory " << shmId << "\n";
+            exit(1);
+        }
+        fuzzCoverageMap = (uint8_t*)map;
+    }
+
+    emulator = new Emulator(image, options);
+    emulator->fuzz_init();
+
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    emulator->fuzz_one_input(data, size);
+    return 0;
+}
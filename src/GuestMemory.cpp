@@ -0,0 +1,87 @@
+#include "./../inc/GuestMemory.h"
+
+GuestMemory::GuestMemory(): privatePages(0), sharedPages(0), copiedPages(0)
+{
+    for(uint32_t i = 0; i < PAGE_DIRECTORY_SIZE; i ++){
+        directory[i] = nullptr;
+    }
+}
+
+GuestMemory::~GuestMemory()
+{
+    clear();
+}
+
+/**
+ * Drops every page. Shared pages are owned by the image, only private ones are freed.
+ */
+void GuestMemory::clear()
+{
+    for(uint32_t i = 0; i < PAGE_DIRECTORY_SIZE; i ++){
+        if(directory[i] == nullptr){
+            continue;
+        }
+
+        for(PageEntry& entry: directory[i]->entries){
+            delete[] entry.write;
+        }
+        delete directory[i];
+        directory[i] = nullptr;
+    }
+
+    privatePages = 0;
+    sharedPages = 0;
+    copiedPages = 0;
+}
+
+GuestMemory::PageEntry* GuestMemory::create_entry(uint32_t address)
+{
+    PageTable*& table = directory[address >> (PAGE_BITS + PAGE_TABLE_BITS)];
+
+    if(table == nullptr){
+        table = new PageTable;
+        for(PageEntry& entry: table->entries){
+            entry = { nullptr, nullptr, -1 };
+        }
+    }
+
+    return &table->entries[(address >> PAGE_BITS) & ((1 << PAGE_TABLE_BITS) - 1)];
+}
+
+/**
+ * Maps a page of the shared image. It must stay valid while this memory uses it.
+ */
+void GuestMemory::map_shared(uint32_t address, const unsigned char* data, int32_t sharedIndex)
+{
+    PageEntry* entry = create_entry(address);
+
+    delete[] entry->write;
+    *entry = { data, nullptr, sharedIndex };
+    sharedPages ++;
+}
+
+/**
+ * Store into a page that is not private yet: new zeroed page, or a copy of the shared one.
+ */
+unsigned char* GuestMemory::private_page(uint32_t address)
+{
+    PageEntry* entry = create_entry(address);
+
+    if(entry->write != nullptr){
+        return entry->write;
+    }
+
+    unsigned char* page = new unsigned char[PAGE_SIZE];
+    if(entry->read != nullptr){
+        memcpy(page, entry->read, PAGE_SIZE);
+        sharedPages --;
+        copiedPages ++;
+    } else {
+        memset(page, 0, PAGE_SIZE);
+    }
+
+    *entry = { page, page, -1 };
+    privatePages ++;
+
+    return page;
+}
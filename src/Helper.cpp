@@ -1,49 +1,116 @@
 
-#include "./../inc/Helper.h"
 #include "./../inc/Assembler.h"
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 using namespace std;
 
 
-/** 
- * Arguments. 
+/**
+ * Messages of one file of a -j run, printed with its line of the report.
  */
-vector<string> argumentsList;
+struct AssemblerLogStruct{
+  ostringstream text;
+};
+
+static ostream& log_stream(AssemblerLog* log){
+  return log != NULL ? log->text : cout;
+}
 
 /**
- * Assembler
+ * State of one assembly run, see Helper.h.
  */
-Assembler assembler;
+struct AssemblerContextStruct{
+  Assembler assembler;
+
+  /** 
+   * Arguments. 
+   */
+  vector<string> argumentsList;
+
+  /**
+   * Whether or not we encountered .end in code.
+   */
+  bool endEncountered;
+
+  /**
+   * An error ended this file, the rest of the parse does nothing.
+   */
+  bool failed;
+
+  AssemblerContextStruct(): endEncountered(false), failed(false) {}
+};
+
+extern "C" AssemblerContext* create_assembler_context(char* outputFile, AssemblerLog* log){
+  AssemblerContext* context = new AssemblerContext();
+  context->assembler.set_output_file(outputFile);
+  context->assembler.set_messages(&log_stream(log));
+  return context;
+}
+
+extern "C" void destroy_assembler_context(AssemblerContext* context){
+  delete context;
+}
+
+extern "C" void print_message(AssemblerContext* context, const char* message){
+  context->assembler.get_messages() << message << endl;
+}
 
 /**
- * Global boolean that checks whether or not we encountered .end in code.
+ * Tokens are views into the source, the assembler gets its own copy of the text.
  */
+static string token_string(const Token* token){
+  return string(token->text, token->length);
+}
 
-bool endEncountered = false;
+/**
+ * Runs an assembler call for the parser. An error can't unwind through the (C) parser, it
+ * marks the context failed instead and later calls are skipped.
+ */
+template <typename Function>
+static void guarded(AssemblerContext* context, Function function){
+  if(context->failed){
+    return;
+  }
 
+  try{
+    function();
+  } catch(const AssemblerError&){
+    context->failed = true;
+  } catch(const exception& e){
+    context->assembler.get_messages() << "Assembler: ERROR -> " << e.what() << endl;
+    context->failed = true;
+  }
+}
 
 /**
  * Function for processing instructions. 
  */
-extern "C" void proc_instruction(Instruction name, ...){
-
-  va_list args;
+static void process_instruction(AssemblerContext* context, Instruction name, const Token* arg1, const Token* arg2, const Token* arg3){
 
-  va_start(args, name);
+  Assembler& assembler = context->assembler;
+  vector<string>& argumentsList = context->argumentsList;
 
-  // traverse through arguments and add them to argument list if they were not added previously;
-  if(name != WORD && name != EXTERN && name != GLOBAL){
+  // operands of list directives were pushed to the list during parsing
+  if(name != WORD && name != EXTERN && name != GLOBAL && name != EQU){
     argumentsList.clear();
-    for( const char* str = va_arg(args, const char*); str != NULL; str = va_arg(args, const char*)){
-      if(name == GLOBAL) cout << str;
-      argumentsList.push_back(str);
+    for(const Token* arg: { arg1, arg2, arg3 }){
+      if(arg != NULL){
+        argumentsList.push_back(token_string(arg));
+      }
     }
   }
 
-  va_end(args);
-
   // process instruction.
 
   switch(name){
@@ -66,12 +133,15 @@ extern "C" void proc_instruction(Instruction name, ...){
       assembler.ascii(argumentsList[0].substr(1, argumentsList[0].size() - 2)); // strip off of ""
       break;
     case EQU:
-      assembler.equ(); 
+      assembler.equ(argumentsList);
+      break;
+    case LTORG:
+      assembler.ltorg();
       break;
     case END:
       assembler.end();
-      endEncountered = true;
-      cout << "Assembling done!" << endl;
+      context->endEncountered = true;
+      assembler.get_messages() << "Assembling done!" << endl;
       break;
     case HALT:
       assembler.halt();
@@ -82,24 +152,9 @@ extern "C" void proc_instruction(Instruction name, ...){
     case IRET:
       assembler.iret();
       break;
-    case CALL:
-      assembler.call(argumentsList[0]);
-      break;
     case RET:
       assembler.ret();
       break;
-    case JMP:
-      assembler.jmp(argumentsList[0]);
-      break;
-    case BEQ:
-      assembler.beq(argumentsList);
-      break;
-    case BNE:
-      assembler.bne(argumentsList);
-      break;
-    case BGT:
-      assembler.bgt(argumentsList);
-      break;
     case PUSH:
       assembler.push(argumentsList[0]);
       break;
@@ -139,12 +194,6 @@ extern "C" void proc_instruction(Instruction name, ...){
     case SHR:
       assembler.shr(argumentsList);
       break;
-    case LD:
-      assembler.ld(argumentsList);
-      break; 
-    case ST:
-      assembler.st(argumentsList);
-      break;
     case CSRRD:
       assembler.csrrd(argumentsList);
       break;
@@ -155,34 +204,278 @@ extern "C" void proc_instruction(Instruction name, ...){
       assembler.label(argumentsList[0]);
       break;
     default:
-      cout << "Assembler: ERROR -> unknown instruction with index " << name << endl;
-      exit(0);
+      assembler.get_messages() << "Assembler: ERROR -> unknown instruction with index " << name << endl;
+      throw AssemblerError();
       break;
   };
 }
 
+// the parser's entry for instructions and directives without an operand
+extern "C" void proc_instruction(AssemblerContext* context, Instruction name, const Token* arg1, const Token* arg2, const Token* arg3){
+  guarded(context, [&]{ process_instruction(context, name, arg1, arg2, arg3); });
+}
+
 /**
- * Function for pushing argument to a global list of arguments during parsing.
+ * Instructions with an operand (see Operand in Helper.h) and up to two general registers.
  */
-extern "C" void push_back_list(char* arg){
+static void process_operand_instruction(AssemblerContext* context, Instruction name, Operand operand, const Token* gpr1, const Token* gpr2){
+
+  Assembler& assembler = context->assembler;
+
+  switch(name){
+    case CALL:
+      assembler.call(operand);
+      break;
+    case JMP:
+      assembler.jmp(operand);
+      break;
+    case BEQ:
+      assembler.beq(assembler.general_register_string_to_index(token_string(gpr1)), assembler.general_register_string_to_index(token_string(gpr2)), operand);
+      break;
+    case BNE:
+      assembler.bne(assembler.general_register_string_to_index(token_string(gpr1)), assembler.general_register_string_to_index(token_string(gpr2)), operand);
+      break;
+    case BGT:
+      assembler.bgt(assembler.general_register_string_to_index(token_string(gpr1)), assembler.general_register_string_to_index(token_string(gpr2)), operand);
+      break;
+    case LD:
+      assembler.ld(operand, assembler.general_register_string_to_index(token_string(gpr1)));
+      break;
+    case ST:
+      assembler.st(assembler.general_register_string_to_index(token_string(gpr1)), operand);
+      break;
+    default:
+      assembler.get_messages() << "Assembler: ERROR -> instruction with index " << name << " has no operand" << endl;
+      throw AssemblerError();
+      break;
+  };
+}
+
+// the parser's entry for instructions with an operand
+extern "C" void proc_operand_instruction(AssemblerContext* context, Instruction name, Operand operand, const Token* gpr1, const Token* gpr2){
+  guarded(context, [&]{ process_operand_instruction(context, name, operand, gpr1, gpr2); });
+}
 
-  argumentsList.push_back(arg);
+extern "C" Operand make_operand(AssemblerContext* context, OperandKind kind, const Token* reg, const Token* literal, const Token* symbol){
+  Operand operand = { kind, -1, 0, -1 };
+  guarded(context, [&]{ operand = context->assembler.make_operand(kind, reg, literal, symbol); });
+  return operand;
 }
 
 /**
- * When we begin pushing arguments to a global list, we have to clear it with this function.
+ * Function for pushing argument to the list of arguments during parsing.
  */
-extern "C" void clear_list(){
-  argumentsList.clear();
+extern "C" void push_back_list(AssemblerContext* context, Token arg){
+
+  context->argumentsList.push_back(token_string(&arg));
+}
+
+/**
+ * When we begin pushing arguments to the list, we have to clear it with this function.
+ */
+extern "C" void clear_list(AssemblerContext* context){
+  context->argumentsList.clear();
+}
+
+/**
+ * The scanner wants the source followed by two null bytes, and writes into it (it puts a null
+ * after the current token for the time of its action).
+ *
+ * A regular file is mapped private (copy on write) over an anonymous mapping one page
+ * longer than needed, the rest of the last file page and the page after it read as zeros.
+ * Anything else (a pipe) is read into an anonymous mapping, so both are released the same way.
+ */
+static size_t source_mapping_size(size_t size){
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  return (size + 2 + pageSize - 1) / pageSize * pageSize;
+}
+
+extern "C" char* map_source_file(const char* name, size_t* size, AssemblerLog* log){
+  int file = open(name, O_RDONLY);
+  struct stat fileStat;
+
+  if(file < 0 || fstat(file, &fileStat) != 0){
+    log_stream(log) << "Assembler: ERROR -> could not open " << name << ": " << strerror(errno) << endl;
+    if(file >= 0){
+      close(file);
+    }
+    return NULL;
+  }
+
+  vector<char> content;
+  if(S_ISREG(fileStat.st_mode)){
+    *size = fileStat.st_size;
+  } else {
+    char chunk[1 << 16];
+    ssize_t count;
+    while((count = read(file, chunk, sizeof(chunk))) > 0){
+      content.insert(content.end(), chunk, chunk + count);
+    }
+    *size = content.size();
+  }
+
+  void* source = mmap(NULL, source_mapping_size(*size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(source != MAP_FAILED && S_ISREG(fileStat.st_mode) && *size > 0){
+    void* mapped = mmap(source, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file, 0);
+    if(mapped == MAP_FAILED){
+      munmap(source, source_mapping_size(*size));
+      source = MAP_FAILED;
+    } else {
+      madvise(source, *size, MADV_SEQUENTIAL);
+    }
+  } else if(source != MAP_FAILED){
+    memcpy(source, content.data(), content.size());
+  }
+  close(file);
+
+  if(source == MAP_FAILED){
+    log_stream(log) << "Assembler: ERROR -> could not map " << name << ": " << strerror(errno) << endl;
+    return NULL;
+  }
+
+  return (char*)source;
+}
+
+extern "C" void unmap_source_file(char* source, size_t size){
+  munmap(source, source_mapping_size(size));
 }
 
 /**
  * Check if we have .end directive at the end of assembly
  */
-extern "C" int check_end(){
-  return (endEncountered == true)? 1:0;
+extern "C" int check_end(AssemblerContext* context){
+  return (context->endEncountered == true)? 1:0;
+}
+
+extern "C" int check_failed(AssemblerContext* context){
+  return (context->failed == true)? 1:0;
+}
+
+/**
+ * Output file of one input when several are assembled: outdir/name.o
+ */
+static string object_file_name(string outputDirectory, string inputFile){
+  filesystem::path path = filesystem::path(outputDirectory) / filesystem::path(inputFile).filename();
+  path.replace_extension(".o");
+  return path.string();
 }
 
-extern "C" void set_output_file(char* name){
-  assembler.set_output_file(name);
-}
\ No newline at end of file
+/**
+ * assembler -o file.o file.s
+ * assembler -j N -o outdir a.s b.s c.s ...
+ *
+ * With several inputs (or -j) -o names a directory and every input gets outdir/name.o.
+ * Files are handed out to N threads, each assembles its file with its own context and
+ * writes the object, then takes the next one. Time of every file is reported at the end.
+ * An error ends only its own file: the other files are still assembled, the failed one is
+ * marked FAILED in the report and the exit status is 1. Messages of every file are printed
+ * with its line of the report.
+ */
+int main(int argc, char* argv[]){
+  printf("ASSEMBLER STARTING...\n");
+
+  char* outputFile = NULL;
+  vector<string> inputFiles;
+  int threadCount = 0;
+
+  // Traverse command line arguments
+  for (int i = 1; i < argc; i++) {
+      // Check for the -o option and extract the output file
+      if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+          outputFile = argv[i + 1];
+          i++;  // Skip next argument since it is the output file
+      } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+          threadCount = atoi(argv[i + 1]);
+          i++;
+          if (threadCount < 1) {
+              cout << "Assembler: ERROR -> -j needs a positive number of threads" << endl;
+              return 1;
+          }
+      } else {
+          // Remaining arguments are input files
+          inputFiles.push_back(argv[i]);
+      }
+  }
+
+  if (inputFiles.empty() || outputFile == NULL) {
+      cout << "Assembler: ERROR -> usage: assembler [-j N] -o output input.s ..." << endl;
+      return 1;
+  }
+
+  if (inputFiles.size() == 1 && threadCount == 0) {
+      return assemble_file(&inputFiles[0][0], outputFile, NULL);
+  }
+
+  error_code error;
+  filesystem::create_directories(outputFile, error);
+  if (error) {
+      cout << "Assembler: ERROR -> could not create output directory " << outputFile << ": " << error.message() << endl;
+      return 1;
+  }
+
+  // two inputs with the same name (a/x.s, b/x.s) would be written to the same object at once
+  vector<string> outputFiles;
+  unordered_map<string, string> outputInputs;
+  for (string inputFile: inputFiles) {
+      string objectFile = object_file_name(outputFile, inputFile);
+      if (outputInputs.find(objectFile) != outputInputs.end()) {
+          cout << "Assembler: ERROR -> " << outputInputs[objectFile] << " and " << inputFile
+              << " would both be written to " << objectFile << endl;
+          return 1;
+      }
+      outputInputs[objectFile] = inputFile;
+      outputFiles.push_back(objectFile);
+  }
+
+  vector<int> results(inputFiles.size(), 0);
+  vector<AssemblerLog> logs(inputFiles.size());
+  vector<double> milliseconds(inputFiles.size(), 0);
+  atomic<size_t> nextFile(0);
+
+  auto worker = [&]() {
+      for (size_t i = nextFile++; i < inputFiles.size(); i = nextFile++) {
+          auto start = chrono::steady_clock::now();
+          results[i] = assemble_file(&inputFiles[i][0], &outputFiles[i][0], &logs[i]);
+          milliseconds[i] = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+      }
+  };
+
+  if (threadCount == 0) {
+      threadCount = 1;
+  }
+  threadCount = min<size_t>(threadCount, inputFiles.size());
+
+  auto start = chrono::steady_clock::now();
+
+  vector<thread> threads;
+  for (int i = 0; i < threadCount; i++) {
+      threads.push_back(thread(worker));
+  }
+  for (thread& t: threads) {
+      t.join();
+  }
+
+  double total = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  int failed = 0;
+  for (size_t i = 0; i < inputFiles.size(); i++) {
+      cout << "Assembler: " << inputFiles[i] << " -> " << outputFiles[i]
+          << " " << fixed << setprecision(3) << milliseconds[i] << " ms"
+          << (results[i] != 0 ? "  FAILED" : "") << endl;
+
+      // what the file printed, under its line
+      istringstream messages(logs[i].text.str());
+      string line;
+      while (getline(messages, line)) {
+          cout << "    " << line << endl;
+      }
+
+      if (results[i] != 0) {
+          failed++;
+      }
+  }
+  cout << "Assembler: " << inputFiles.size() << " files on " << threadCount << " threads in "
+      << fixed << setprecision(3) << total << " ms" << endl;
+
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+#include "./../inc/InterruptController.h"
+#include <algorithm>
+
+const InterruptController::PriorityEntry InterruptController::priorities[] = {
+    { CAUSE_TIMER, TIMER_BIT },
+    { CAUSE_TERMINAL, TERMINAL_BIT },
+    { CAUSE_BLOCK, BLOCK_BIT }
+};
+
+const int InterruptController::numberOfPriorities = sizeof(priorities) / sizeof(priorities[0]);
+
+void InterruptController::raise(uint32_t cause)
+{
+    // a raise while the interrupt is still pending merges with the first one
+    if(!(pending.load(std::memory_order_relaxed) & (1u << cause))){
+        raiseTime[cause].store(now(), std::memory_order_relaxed);
+    }
+    pending.fetch_or(1u << cause, std::memory_order_release);
+}
+
+void InterruptController::clear(uint32_t cause)
+{
+    pending.fetch_and(~(1u << cause), std::memory_order_acq_rel);
+}
+
+/**
+ * Picks the highest priority pending interrupt that is not masked by the status register,
+ * clears its pending bit and returns its cause. Returns 0 if nothing can be taken.
+ */
+uint32_t InterruptController::acknowledge(uint32_t status)
+{
+    uint32_t current = pending.load(std::memory_order_acquire);
+
+    // global mask
+    if(current == 0 || ((status >> INTERRUPT_BIT) & 0x1)){
+        return 0;
+    }
+
+    for(int i = 0; i < numberOfPriorities; i ++){
+        const PriorityEntry& entry = priorities[i];
+
+        if((current & (1u << entry.cause)) && !((status >> entry.maskBit) & 0x1)){
+            clear(entry.cause);
+            return entry.cause;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t LatencyHistogram::bucket_of(uint64_t value)
+{
+    if(value < HISTOGRAM_SUB_BUCKETS){
+        return value;
+    }
+
+    // HISTOGRAM_SUB_BUCKETS = 2^4: the 4 bits below the leading one pick the sub bucket
+    uint32_t shift = 63 - __builtin_clzll(value) - 4;
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::bucket_end(uint32_t bucket)
+{
+    if(bucket < HISTOGRAM_SUB_BUCKETS){
+        return bucket;
+    }
+
+    uint32_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t start = (uint64_t)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+    return start + ((uint64_t)1 << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    buckets[bucket_of(value)] ++;
+    count ++;
+    max = std::max(max, value);
+}
+
+uint64_t LatencyHistogram::percentile(double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * count + 0.999999);
+    uint64_t seen = 0;
+
+    for(uint32_t i = 0; i < HISTOGRAM_BUCKETS; i ++){
+        seen += buckets[i];
+        if(seen >= std::max<uint64_t>(rank, 1)){
+            return std::min(bucket_end(i), max);
+        }
+    }
+
+    return max;
+}
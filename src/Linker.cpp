@@ -39,6 +39,10 @@ void Linker::startLinking()
             //printSectionCode(sTemp->name, sectionMachineCodesGeneral[sTemp->name]);
         }
         generate_executable_elf();
+
+        if(!mapFile.empty()){
+            generate_symbol_map();
+        }
     }
     //printSymbolTable(symbolTableGeneral);
 }
@@ -102,7 +106,7 @@ void Linker::generate_file_structures()
                     symtab[i].st_size,
                     (ELF32_ST_TYPE(symtab[i].st_info) == STT_NOTYPE? NOTYP:SCTN),
                     (ELF32_ST_BIND(symtab[i].st_info) == STB_LOCAL? LOC:GLOB),
-                    ( (symtab[i].st_shndx - 3) / 2 ) + 1,
+                    (symtab[i].st_shndx == SHN_ABS? ABS: ( (symtab[i].st_shndx - 3) / 2 ) + 1),
                     tempName,
                     false
             );
@@ -297,6 +301,17 @@ void Linker::generate_new_tables()
                 continue;
             }
 
+            // absolute symbol, keeps its value
+            if(strTemp->ndx == ABS){
+                SymbolTableRow* sTemp = new SymbolTableRow(
+                    symbolTableGeneral.size(), strTemp->value, 0, NOTYP,
+                    strTemp->bind, ABS, strTemp->name, false
+                );
+                symbolTableGeneral.push_back(sTemp);
+                symbolTableMapGeneral[strTemp->name] = sTemp;
+                continue;
+            }
+
             string sectionName = find_section_name_based_on_ndx(symbolTableTemp, strTemp->ndx);
     
             int newNum = symbolTableGeneral.size();
@@ -596,6 +611,9 @@ void Linker::resolve_symbols()
         if(sTemp->type == SCTN){
             continue;
         }
+        if(sTemp->ndx == ABS){
+            continue;
+        }
 
         string hisSectionName = find_section_name_based_on_ndx(symbolTableGeneral, sTemp->ndx);
         uint32_t hisSectionStartAddress = symbolTableMapGeneral[hisSectionName]->value;
@@ -969,7 +987,7 @@ void Linker::printSymbolTable(vector<SymbolTableRow *> symbolTable)
             << left << setw(10) << (row->type == NOTYP ? "NOTYP" :
                                     (row->type == WFI? "WFI":"SCTN") )
             << left << setw(10) << (row->bind == LOC ? "LOC" : "GLOB")
-            << left << setw(5) << (row->ndx == UND ? "UND" : (row->ndx == EXT? "EXT":to_string(row->ndx)))
+            << left << setw(5) << (row->ndx == UND ? "UND" : (row->ndx == EXT? "EXT": (row->ndx == ABS? "ABS":to_string(row->ndx))))
             << left << setw(15) << row->name 
             << left << setw(15) << (row->equ == true? "true":"false") << endl;
     }
@@ -1153,6 +1171,9 @@ void Linker::generate_linkable_elf()
         else if(s->ndx == UND){
             newSectionSym.st_shndx = -1;
         }
+        else if(s->ndx == ABS){
+            newSectionSym.st_shndx = SHN_ABS;
+        }
         else{
             // * 2 to compensate for rela, and + 3 to compensate for first 3 sections which are info sections;
             newSectionSym.st_shndx = (s->ndx - 1) * 2 + 3;  
@@ -1481,3 +1502,33 @@ void Linker::generate_executable_elf()
     }
     outFile.close();
 }
+
+
+/**
+ * Symbol map of the executable, one symbol per line:
+ * <address> <size> <SCTN|NOTYP> <name>
+ * 
+ * Used by the emulator to attribute guest addresses to symbols.
+ */
+void Linker::generate_symbol_map()
+{
+    ofstream outFile(mapFile.c_str(), std::ios::out | std::ios::trunc);
+
+    if (!outFile) {
+        std::cout << "Linker: ERROR -> Could not generate a symbol map file." << endl;
+        exit(0);
+    }
+
+    for(SymbolTableRow* strTemp: symbolTableGeneral){
+        if(strTemp->num == 0){
+            continue;
+        }
+
+        outFile << hex << setw(8) << setfill('0') << strTemp->value << " "
+            << hex << setw(8) << setfill('0') << strTemp->size << " "
+            << (strTemp->type == SCTN ? "SCTN" : "NOTYP") << " "
+            << strTemp->name << '\n';
+    }
+
+    outFile.close();
+}
\ No newline at end of file
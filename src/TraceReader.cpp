@@ -0,0 +1,142 @@
+#include "./../inc/TraceReader.h"
+
+void TraceReader::read()
+{
+    std::ifstream file(inputFileName, std::ios::binary);
+
+    if (!file.is_open()) {
+        error_print_and_exit("TraceReader: ERROR -> Could not open file " + inputFileName);
+    }
+
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    file.close();
+
+    if(data.size() < TRACE_MAGIC_SIZE + 1 || std::string(data.begin(), data.begin() + TRACE_MAGIC_SIZE) != TRACE_MAGIC){
+        error_print_and_exit("TraceReader: ERROR -> " + inputFileName + " is not a trace file");
+    }
+    if(data[TRACE_MAGIC_SIZE] != TRACE_VERSION){
+        error_print_and_exit("TraceReader: ERROR -> unsupported trace version " + std::to_string(data[TRACE_MAGIC_SIZE]));
+    }
+    position = TRACE_MAGIC_SIZE + 1;
+
+    if(dump){
+        std::cout << std::hex << std::setfill('0');
+    }
+
+    while(position < data.size()){
+        unsigned char header = data[position++];
+
+        switch(header & TRACE_TYPE_MASK){
+            case TRACE_INSTRUCTION: {
+                uint32_t next = pc + 4;
+                if(header & TRACE_PC_DELTA){
+                    next += get_signed();
+                    if(started && !interruptEntered){
+                        jumps ++;
+                    }
+                }
+                pc = next;
+                started = true;
+                interruptEntered = false;
+
+                if(header & TRACE_NEW_WORD){
+                    words[pc] = get_varint();
+                }
+
+                instructions ++;
+                pcCounts[pc] ++;
+
+                if(dump){
+                    std::cout << std::setw(8) << pc << ": " << std::setw(8) << words[pc] << "\n";
+                }
+                break;
+            }
+            case TRACE_READ:
+            case TRACE_WRITE:
+                address += get_signed();
+                addresses.insert(address & ~3u);
+
+                if((header & TRACE_TYPE_MASK) == TRACE_READ){
+                    reads ++;
+                } else {
+                    writes ++;
+                }
+
+                if(dump){
+                    std::cout << "    " << ((header & TRACE_TYPE_MASK) == TRACE_READ ? "R " : "W ") << std::setw(8) << address << "\n";
+                }
+                break;
+            case TRACE_INTERRUPT: {
+                uint32_t cause = get_varint();
+                interrupts[cause] ++;
+                interruptEntered = true;
+
+                if(dump){
+                    std::cout << "    INT " << std::dec << cause << std::hex << "\n";
+                }
+                break;
+            }
+        }
+    }
+
+    if(!dump){
+        print_summary();
+    }
+}
+
+uint32_t TraceReader::get_varint()
+{
+    uint32_t value = 0;
+    int shift = 0;
+
+    while(true){
+        if(position >= data.size()){
+            error_print_and_exit("TraceReader: ERROR -> trace ends in the middle of a record");
+        }
+
+        unsigned char byte = data[position++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0){
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+int32_t TraceReader::get_signed()
+{
+    uint32_t value = get_varint();
+    return (int32_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+void TraceReader::print_summary()
+{
+    uint64_t bytes = data.size() - TRACE_MAGIC_SIZE - 1;
+
+    std::cout << "Trace " << inputFileName << std::endl;
+    std::cout << "    instructions: " << instructions << " (" << pcCounts.size() << " distinct pcs, " << words.size() << " words)" << std::endl;
+    std::cout << "    jumps taken: " << jumps << std::endl;
+    std::cout << "    memory reads: " << reads << ", writes: " << writes << " (" << addresses.size() << " distinct words)" << std::endl;
+    for(auto& pair: interrupts){
+        std::cout << "    interrupts with cause " << pair.first << ": " << pair.second << std::endl;
+    }
+    std::cout << "    size: " << bytes << " bytes, " << std::fixed << std::setprecision(2)
+        << (double)bytes / std::max<uint64_t>(instructions, 1) << " bytes per instruction" << std::endl;
+
+    std::vector<std::pair<uint32_t, uint64_t>> hottest(pcCounts.begin(), pcCounts.end());
+    std::sort(hottest.begin(), hottest.end(), [](const std::pair<uint32_t, uint64_t>& a, const std::pair<uint32_t, uint64_t>& b){
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+
+    std::cout << "    hottest pcs:" << std::endl;
+    for(size_t i = 0; i < hottest.size() && i < 10; i ++){
+        std::cout << "        0x" << std::hex << std::setw(8) << std::setfill('0') << hottest[i].first << std::dec << std::setfill(' ')
+            << " " << std::setw(12) << hottest[i].second << " " << std::setprecision(2) << 100.0 * hottest[i].second / instructions << "%" << std::endl;
+    }
+}
+
+void TraceReader::error_print_and_exit(std::string errorMessage)
+{
+    std::cout << errorMessage << std::endl;
+    exit(1);
+}
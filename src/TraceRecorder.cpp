@@ -0,0 +1,153 @@
+#include "./../inc/TraceRecorder.h"
+#include <algorithm>
+#include <cstring>
+
+TraceRecorder::TraceRecorder(std::string fileName):
+    ring(TRACE_BUFFER_SIZE), chunkSize(0), previousPc(0), previousAddress(0), instructions(0), bytes(0)
+{
+    head.store(0);
+    tail.store(0);
+    stopFlag.store(false);
+    stopped = false;
+
+    file = fopen(fileName.c_str(), "wb");
+    if(file == nullptr){
+        stopped = true;
+        return;
+    }
+
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, file);
+    fputc(TRACE_VERSION, file);
+
+    writer = std::thread(&TraceRecorder::writer_thread_function, this);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+}
+
+void TraceRecorder::instruction(uint32_t pc, uint32_t word)
+{
+    unsigned char header = TRACE_INSTRUCTION;
+    int32_t delta = pc - (previousPc + 4);
+
+    if(delta != 0){
+        header |= TRACE_PC_DELTA;
+    }
+
+    auto it = seenWords.find(pc);
+    bool newWord = it == seenWords.end() || it->second != word;
+    if(newWord){
+        header |= TRACE_NEW_WORD;
+        seenWords[pc] = word;
+    }
+
+    put_byte(header);
+    if(delta != 0){
+        put_signed(delta);
+    }
+    if(newWord){
+        put_varint(word);
+    }
+
+    previousPc = pc;
+    instructions ++;
+}
+
+void TraceRecorder::memory_access(uint32_t type, uint32_t address)
+{
+    put_byte(type);
+    put_signed(address - previousAddress);
+    previousAddress = address;
+}
+
+void TraceRecorder::interrupt(uint32_t cause)
+{
+    put_byte(TRACE_INTERRUPT);
+    put_varint(cause);
+}
+
+void TraceRecorder::put_varint(uint32_t value)
+{
+    while(value >= 0x80){
+        put_byte((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    put_byte(value);
+}
+
+/**
+ * Moves the local chunk into the ring buffer, waiting for the writer while it is full.
+ */
+void TraceRecorder::flush_chunk()
+{
+    uint64_t position = head.load(std::memory_order_relaxed);
+
+    while(position + chunkSize - tail.load(std::memory_order_acquire) > TRACE_BUFFER_SIZE){
+        cv.notify_one();
+        std::this_thread::yield();
+    }
+
+    uint32_t offset = position % TRACE_BUFFER_SIZE;
+    uint32_t first = std::min<uint32_t>(chunkSize, TRACE_BUFFER_SIZE - offset);
+    memcpy(&ring[offset], chunk, first);
+    memcpy(&ring[0], chunk + first, chunkSize - first);
+
+    position += chunkSize;
+    head.store(position, std::memory_order_release);
+    bytes += chunkSize;
+    chunkSize = 0;
+
+    // wake the writer once a quarter of the ring buffer is waiting
+    if(position - tail.load(std::memory_order_relaxed) > TRACE_BUFFER_SIZE / 4){
+        cv.notify_one();
+    }
+}
+
+void TraceRecorder::writer_thread_function()
+{
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, std::chrono::milliseconds(100));
+        }
+
+        // the last chunk is in the ring buffer before the stop flag is set
+        bool last = stopFlag.load();
+
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t position = tail.load(std::memory_order_relaxed);
+
+        while(position != end){
+            uint32_t offset = position % TRACE_BUFFER_SIZE;
+            uint32_t length = std::min<uint64_t>(end - position, TRACE_BUFFER_SIZE - offset);
+            fwrite(&ring[offset], 1, length, file);
+            position += length;
+            tail.store(position, std::memory_order_release);
+        }
+
+        if(last){
+            break;
+        }
+    }
+}
+
+/**
+ * Writes out everything recorded so far and closes the file. Called from the cpu thread.
+ */
+void TraceRecorder::stop()
+{
+    if(stopped){
+        return;
+    }
+    stopped = true;
+
+    flush_chunk();
+    stopFlag.store(true);
+    cv.notify_one();
+    writer.join();
+
+    fclose(file);
+    file = nullptr;
+}
@@ -0,0 +1,494 @@
+#include "./../inc/Translator.h"
+
+void Translator::translate()
+{
+    load_image();
+    discover();
+
+    if(instructions.empty()){
+        error_print_and_exit("Translator: ERROR -> nothing to translate at the entry points of " + inputFileName);
+    }
+
+    generate();
+
+    std::cout << "Translator: " << instructions.size() << " instructions in " << leaders.size() << " blocks -> " << outputFileName << std::endl;
+}
+
+/**
+ * Same format the emulator loads: "<decimal address>: <hex byte>" per line.
+ */
+void Translator::load_image()
+{
+    std::ifstream file(inputFileName);
+
+    if (!file.is_open()) {
+        error_print_and_exit("Translator: ERROR -> Could not open file " + inputFileName);
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        unsigned int key;
+        std::string hexValue;
+
+        if (iss >> key && std::getline(iss, hexValue, ':')) {
+            iss >> hexValue;
+            memory[key] = static_cast<unsigned char>(std::stoul(hexValue, nullptr, 16));
+        }
+    }
+
+    file.close();
+}
+
+bool Translator::image_word(uint32_t address, uint32_t& word)
+{
+    word = 0;
+    for(uint32_t i = 0; i < WORD_SIZE; i ++){
+        auto it = memory.find(address + i);
+        if(it == memory.end()){
+            return false;
+        }
+        word |= (uint32_t)it->second << (i * 8);
+    }
+    return true;
+}
+
+Translator::Instruction Translator::decode(uint32_t address, uint32_t word)
+{
+    Instruction instruction;
+
+    instruction.address = address;
+    instruction.fullInstruction = word;
+    instruction.oc = (word >> 28) & 0xF;
+    instruction.mod = (word >> 24) & 0xF;
+    instruction.regA = (word >> 20) & 0xF;
+    instruction.regB = (word >> 16) & 0xF;
+    instruction.regC = (word >> 12) & 0xF;
+    instruction.disp = word & 0xFFF;
+
+    // sign extend disp
+    if(instruction.disp & 0x800){
+        instruction.disp |= 0xFFFFF000;
+    }
+
+    return instruction;
+}
+
+/**
+ * Encodings with exactly the semantics the interpreter gives them. Everything else (halt,
+ * encodings the interpreter reports as bad instructions) is left to the interpreter.
+ */
+bool Translator::is_translatable(Instruction instruction)
+{
+    switch(instruction.oc){
+        case 0b0001: // int
+            return instruction.fullInstruction == 0x10000000;
+        case 0b0010: // call
+            return instruction.regC == 0 && instruction.mod <= 0b0001;
+        case 0b0011: // jmp, beq, bne, bgt
+            return (instruction.mod & 0b0111) <= 0b0011;
+        case 0b0100: // xchg
+            return instruction.mod == 0 && instruction.regA == 0 && instruction.disp == 0;
+        case 0b0101: // arithmetic
+        case 0b0110: // logic
+            return instruction.disp == 0 && instruction.mod <= 0b0011;
+        case 0b0111: // shift
+            return instruction.disp == 0 && instruction.mod <= 0b0001;
+        case 0b1000: // st
+            return instruction.mod <= 0b0010;
+        case 0b1001: // ld, csrrd, csrwr
+            return instruction.mod <= 0b0111;
+        default:
+            return false;
+    }
+}
+
+bool Translator::may_write_pc(Instruction instruction)
+{
+    if(instruction.oc <= 0b0011){
+        return true;
+    }
+
+    return instruction.regA == PC_INDEX || instruction.regB == PC_INDEX || instruction.regC == PC_INDEX;
+}
+
+/**
+ * Instructions after which execution does not continue with the next word
+ * (call and int continue there only after the return).
+ */
+bool Translator::always_writes_pc(Instruction instruction)
+{
+    switch(instruction.oc){
+        case 0b0001:
+        case 0b0010:
+            return true;
+        case 0b0011:
+            return instruction.mod == 0b0000 || instruction.mod == 0b1000;
+        case 0b0101:
+        case 0b0110:
+        case 0b0111:
+            return instruction.regA == PC_INDEX;
+        case 0b1001:
+            return instruction.regA == PC_INDEX && instruction.mod >= 0b0001 && instruction.mod <= 0b0011;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Recursive traversal from the entry points. Targets that go through memory (literal pools,
+ * handler addresses) are only predictions: the generated code always checks the actual pc.
+ */
+void Translator::discover()
+{
+    std::deque<uint32_t> worklist;
+    std::set<uint32_t> queued;
+
+    auto enqueue = [&](uint32_t address){
+        if(queued.insert(address).second){
+            worklist.push_back(address);
+        }
+    };
+
+    enqueue(EXECUTE_START_ADDRESS);
+    for(uint32_t entry: entries){
+        enqueue(entry);
+    }
+
+    while(!worklist.empty()){
+        uint32_t address = worklist.front();
+        worklist.pop_front();
+
+        if(address % WORD_SIZE != 0){
+            continue;
+        }
+
+        bool first = true;
+        while(instructions.find(address) == instructions.end()){
+            uint32_t word;
+            if(!image_word(address, word)){
+                break;
+            }
+
+            Instruction instruction = decode(address, word);
+            if(!is_translatable(instruction)){
+                break;
+            }
+
+            if(first){
+                leaders.insert(address);
+                first = false;
+            }
+            instructions[address] = instruction;
+
+            uint32_t next = address + WORD_SIZE;
+            uint32_t pcRelative = next + instruction.disp;
+            uint32_t literal;
+            uint32_t literalTarget;
+
+            // gpr[B] + gpr[C] + D with pc and r0 (zero by convention)
+            bool pcBased = (instruction.regB == PC_INDEX && instruction.regC == 0)
+                || (instruction.regB == 0 && instruction.regC == PC_INDEX);
+
+            if(instruction.oc == 0b0011 && instruction.regA == PC_INDEX){
+                if(instruction.mod <= 0b0011){
+                    targets[address].push_back(pcRelative);
+                } else if(image_word(pcRelative, literal)){
+                    targets[address].push_back(literal);
+                }
+            } else if(instruction.oc == 0b0010){
+                bool callPcBased = (instruction.regA == PC_INDEX && instruction.regB == 0)
+                    || (instruction.regA == 0 && instruction.regB == PC_INDEX);
+                if(callPcBased && instruction.mod == 0b0000){
+                    targets[address].push_back(pcRelative);
+                } else if(callPcBased && image_word(pcRelative, literal)){
+                    targets[address].push_back(literal);
+                }
+            } else if(instruction.oc == 0b1001 && instruction.mod == 0b0010 && pcBased
+                && image_word(pcRelative, literal) && image_word(literal, literalTarget)){
+                // address of something in the image, probably a handler or a function pointer
+                enqueue(literal);
+            }
+
+            for(uint32_t target: targets[address]){
+                enqueue(target);
+            }
+
+            if(instruction.oc == 0b0001 || instruction.oc == 0b0010){
+                // return point
+                enqueue(next);
+            }
+
+            if(always_writes_pc(instruction)){
+                break;
+            }
+
+            address = next;
+        }
+
+        // walked into code that was already discovered from another entry
+        if(first && instructions.find(address) != instructions.end()){
+            leaders.insert(address);
+        }
+    }
+
+    // targets that turned out to be untranslatable go through the interpreter
+    for(auto& pair: targets){
+        std::vector<uint32_t> known;
+        for(uint32_t target: pair.second){
+            if(leaders.find(target) != leaders.end()){
+                known.push_back(target);
+            }
+        }
+        pair.second = known;
+    }
+}
+
+std::string Translator::label(uint32_t address)
+{
+    std::stringstream ss;
+    ss << "L_" << std::hex << std::setw(8) << std::setfill('0') << address;
+    return ss.str();
+}
+
+static std::string hex(uint32_t value)
+{
+    std::stringstream ss;
+    ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << value << "u";
+    return ss.str();
+}
+
+static std::string reg(uint32_t index)
+{
+    return "r[" + std::to_string(index) + "]";
+}
+
+/**
+ * Semantics of one instruction, statement for statement what Emulator::decode_and_execute does.
+ */
+std::string Translator::generate_instruction(Instruction instruction)
+{
+    std::string A = reg(instruction.regA);
+    std::string B = reg(instruction.regB);
+    std::string C = reg(instruction.regC);
+    std::string D = hex(instruction.disp);
+    std::string push = "    r[14] = r[14] - 4; emu.memory_set_word(r[14], r[15]);\n";
+    std::string condition;
+
+    switch(instruction.oc){
+        case 0b0001:
+            return "    emu.interrupt_enter(CAUSE_SOFTWARE);\n";
+        case 0b0010:
+            if(instruction.mod == 0b0000){
+                return push + "    r[15] = " + A + " + " + B + " + " + D + ";\n";
+            }
+            return push + "    r[15] = emu.memory_get_word(" + A + " + " + B + " + " + D + ");\n";
+        case 0b0011:
+            switch(instruction.mod & 0b0111){
+                case 0b0001: condition = "if(" + B + " == " + C + ") "; break;
+                case 0b0010: condition = "if(" + B + " != " + C + ") "; break;
+                case 0b0011: condition = "if(" + B + " > " + C + ") "; break;
+            }
+            if(instruction.mod & 0b1000){
+                return "    " + condition + "r[15] = emu.memory_get_word(" + A + " + " + D + ");\n";
+            }
+            return "    " + condition + "r[15] = " + A + " + " + D + ";\n";
+        case 0b0100:
+            return "    { uint32_t temp = " + B + "; " + B + " = " + C + "; " + C + " = temp; }\n";
+        case 0b0101: {
+            const char* operators[] = { " + ", " - ", " * ", " / " };
+            return "    " + A + " = " + B + operators[instruction.mod] + C + ";\n";
+        }
+        case 0b0110: {
+            if(instruction.mod == 0b0000){
+                return "    " + A + " = ~" + B + ";\n";
+            }
+            const char* operators[] = { "", " & ", " | ", " ^ " };
+            return "    " + A + " = " + B + operators[instruction.mod] + C + ";\n";
+        }
+        case 0b0111:
+            return "    " + A + " = " + B + (instruction.mod == 0b0000 ? " << " : " >> ") + C + ";\n";
+        case 0b1000:
+            if(instruction.mod == 0b0000){
+                return "    emu.memory_set_word(" + A + " + " + B + " + " + D + ", " + C + ");\n";
+            } else if(instruction.mod == 0b0010){
+                return "    emu.memory_set_word(emu.memory_get_word(" + A + " + " + B + " + " + D + "), " + C + ");\n";
+            }
+            return "    " + A + " = " + A + " + " + D + "; emu.memory_set_word(" + A + ", " + C + ");\n";
+        case 0b1001:
+            switch(instruction.mod){
+                case 0b0000:
+                    return "    " + A + " = emu.csr_get(" + std::to_string(instruction.regB) + ");\n";
+                case 0b0001:
+                    return "    " + A + " = " + B + " + " + D + ";\n";
+                case 0b0010:
+                    if(instruction.regA == 15){
+                        return "    emu.interrupt_return(" + B + " + " + C + " + " + D + "); " + A + " = emu.memory_get_word(" + B + " + " + C + " + " + D + ");\n";
+                    }
+                    return "    " + A + " = emu.memory_get_word(" + B + " + " + C + " + " + D + ");\n";
+                case 0b0011:
+                    if(instruction.regA == 15){
+                        return "    emu.interrupt_return(" + B + "); " + A + " = emu.memory_get_word(" + B + "); " + B + " = " + B + " + " + D + ";\n";
+                    }
+                    return "    " + A + " = emu.memory_get_word(" + B + "); " + B + " = " + B + " + " + D + ";\n";
+                case 0b0100:
+                    return "    emu.csr_set(" + std::to_string(instruction.regA) + ", " + B + ");\n";
+                case 0b0101:
+                    return "    emu.csr_set(" + std::to_string(instruction.regA) + ", emu.csr_get(" + std::to_string(instruction.regB) + ") | " + D + ");\n";
+                case 0b0110:
+                    return "    emu.csr_set(" + std::to_string(instruction.regA) + ", emu.memory_get_word(" + B + " + " + C + " + " + D + "));\n";
+                default:
+                    return "    emu.csr_set(" + std::to_string(instruction.regA) + ", emu.memory_get_word(" + B + ")); " + B + " = " + B + " + " + D + ";\n";
+            }
+    }
+
+    error_print_and_exit("Translator: ERROR -> no translation for " + hex(instruction.fullInstruction));
+    return "";
+}
+
+/**
+ * Every instruction is followed by the same bookkeeping the interpreter loop does: pc is set
+ * to the next word before execution, the virtual clock ticks after it, and pending interrupts
+ * are taken when the instruction did not fall through. A block whose words the guest has
+ * overwritten hands control back to the interpreter.
+ */
+void Translator::generate()
+{
+    std::ofstream out(outputFileName);
+
+    if (!out.is_open()) {
+        error_print_and_exit("Translator: ERROR -> Could not open file " + outputFileName);
+    }
+
+    // block index of every instruction
+    std::map<uint32_t, uint32_t> blocks;
+    uint32_t block = 0;
+    for(auto& pair: instructions){
+        if(leaders.find(pair.first) != leaders.end() && !blocks.empty()){
+            block ++;
+        }
+        blocks[pair.first] = block;
+    }
+
+    out << "// Generated by the translator from " << inputFileName << ", do not edit.\n";
+    out << "#include \"Emulator.h\"\n\n";
+
+    out << "static const uint32_t translatedAddresses[] = {";
+    int column = 0;
+    for(auto& pair: instructions){
+        out << (column++ % 8 == 0 ? "\n    " : " ") << hex(pair.first) << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "static const uint32_t translatedWords[] = {";
+    column = 0;
+    for(auto& pair: instructions){
+        out << (column++ % 8 == 0 ? "\n    " : " ") << hex(pair.second.fullInstruction) << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "static const uint32_t translatedBlocks[] = {";
+    column = 0;
+    for(auto& pair: blocks){
+        out << (column++ % 16 == 0 ? "\n    " : " ") << pair.second << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "class TranslatedProgram{\n";
+    out << "public:\n";
+    out << "    static uint32_t run(Emulator& emu);\n";
+    out << "    static bool verify(Emulator& emu);\n";
+    out << "};\n\n";
+
+    out << "#define TICK() if(++emu.virtualClock >= emu.nextEventTime) emu.run_scheduled_events()\n";
+    out << "#define BLOCK_END() if(emu.interruptController.has_pending()) emu.interrupt_check()\n";
+    out << "#define BLOCK_VALID(block) if(emu.invalidBlocks[block]) return r[15]\n";
+    out << "#define CODE_CHECK(block) if(emu.codeModified){ emu.codeModified = false; BLOCK_VALID(block); }\n\n";
+
+    out << "bool TranslatedProgram::verify(Emulator& emu)\n{\n";
+    out << "    for(uint32_t i = 0; i < " << instructions.size() << "; i ++){\n";
+    out << "        if(emu.memory_get_word(translatedAddresses[i]) != translatedWords[i]){\n";
+    out << "            return false;\n";
+    out << "        }\n";
+    out << "    }\n";
+    out << "    return true;\n";
+    out << "}\n\n";
+
+    out << "uint32_t TranslatedProgram::run(Emulator& emu)\n{\n";
+    out << "    uint32_t* r = emu.gprx;\n\n";
+
+    // host address of every block (and of the end of the function) for the perf map
+    out << "    static const void* const blockStarts[] = {";
+    column = 0;
+    for(uint32_t leader: leaders){
+        out << (column++ % 4 == 0 ? "\n        " : " ") << "&&" << label(leader) << ",";
+    }
+    out << "\n        &&L_end\n    };\n";
+    out << "    if(emu.describeTranslatedCode){\n";
+    out << "        emu.translatedBlockStarts = blockStarts;\n";
+    out << "        return r[15];\n";
+    out << "    }\n\n";
+
+    out << "dispatch:\n";
+    out << "    switch(r[15]){\n";
+    for(uint32_t leader: leaders){
+        out << "        case " << hex(leader) << ": goto " << label(leader) << ";\n";
+    }
+    out << "        default: return r[15];\n";
+    out << "    }\n";
+
+    for(auto it = instructions.begin(); it != instructions.end(); it ++){
+        Instruction instruction = it->second;
+        uint32_t address = instruction.address;
+        uint32_t next = address + WORD_SIZE;
+
+        if(leaders.find(address) != leaders.end()){
+            out << "\n" << label(address) << ":\n";
+            out << "    BLOCK_VALID(" << blocks[address] << ");\n";
+        }
+
+        out << "    // " << std::hex << std::setw(8) << std::setfill('0') << address << ": "
+            << std::setw(8) << instruction.fullInstruction << std::dec << "\n";
+        out << "    r[15] = " << hex(next) << ";\n";
+        out << generate_instruction(instruction);
+        out << "    TICK();\n";
+
+        if(may_write_pc(instruction)){
+            out << "    if(r[15] != " << hex(next) << "){\n";
+            out << "        BLOCK_END();\n";
+            for(uint32_t target: targets[address]){
+                out << "        if(r[15] == " << hex(target) << ") goto " << label(target) << ";\n";
+            }
+            out << "        goto dispatch;\n";
+            out << "    }\n";
+        }
+
+        out << "    CODE_CHECK(" << blocks[address] << ");\n";
+
+        auto following = std::next(it);
+        if(following == instructions.end() || following->first != next){
+            out << "    return r[15];\n";
+        }
+    }
+
+    out << "\nL_end:\n";
+    out << "    return r[15];\n";
+    out << "}\n\n";
+
+    out << "static TranslatedCode translatedCode = {\n";
+    out << "    TranslatedProgram::run, TranslatedProgram::verify,\n";
+    out << "    translatedAddresses, translatedBlocks, " << instructions.size() << ", " << (instructions.empty() ? 0 : block + 1) << "\n";
+    out << "};\n\n";
+
+    out << "static struct TranslatedCodeRegistration{\n";
+    out << "    TranslatedCodeRegistration(){ Emulator::register_translated_code(&translatedCode); }\n";
+    out << "} translatedCodeRegistration;\n";
+
+    out.close();
+}
+
+void Translator::error_print_and_exit(std::string errorMessage)
+{
+    std::cout << errorMessage << std::endl;
+    exit(1);
+}